@@ -0,0 +1,49 @@
+#!/bin/sh
+# Esegue uno studio parametrico di omnetpp.ini su tutti i core locali e unisce gli scalari.
+#
+# Uso: ./run_study.sh <Config> [jobs]
+#   Config  sezione di configs/omnetpp.ini (es. GuardSweep, DesignSpace)
+#   jobs    processi paralleli (default: numero di core)
+#
+# Output in simulations/results:
+#   <Config>-*.sca         una per run
+#   <Config>.csv           tutti gli scalari (CSV-R)
+#   <Config>-perf.csv      solo tdmaScheduler.perf* (baseline prestazioni)
+
+set -e
+
+CONFIG="$1"
+if [ -z "$CONFIG" ]; then
+    echo "Uso: $0 <Config> [jobs]" >&2
+    exit 1
+fi
+JOBS="${2:-$(nproc 2>/dev/null || sysctl -n hw.ncpu 2>/dev/null || echo 1)}"
+
+HERE="$(cd "$(dirname "$0")" && pwd)"
+ROOT="$(dirname "$HERE")"
+BIN="$ROOT/src/AutomotiveTDMANetwork"
+RESULTS="$HERE/results"
+
+if [ ! -x "$BIN" ] && [ ! -x "${BIN}_dbg" ]; then
+    echo "Eseguibile non trovato: compilare con 'make' nella root del progetto" >&2
+    exit 1
+fi
+[ -x "$BIN" ] || BIN="${BIN}_dbg"
+
+cd "$HERE/configs"
+
+NRUNS="$("$BIN" -q numruns -c "$CONFIG" -n "$ROOT/src:$HERE" omnetpp.ini 2>/dev/null | tail -n 1 || true)"
+echo "Studio $CONFIG: ${NRUNS:-?} run su $JOBS processi"
+
+# Le run precedenti dello stesso studio falserebbero il merge
+rm -f "$RESULTS/$CONFIG"-*.sca "$RESULTS/$CONFIG"-*.vec "$RESULTS/$CONFIG"-*.vci
+
+START=$(date +%s)
+opp_runall -j"$JOBS" "$BIN" -u Cmdenv -c "$CONFIG" -n "$ROOT/src:$HERE" omnetpp.ini
+END=$(date +%s)
+
+opp_scavetool export -T s -F CSV-R -o "$RESULTS/$CONFIG.csv" "$RESULTS/$CONFIG"-*.sca
+opp_scavetool export -T s -F CSV-R -f 'module =~ "*.tdmaScheduler" AND name =~ "perf*"' \
+    -o "$RESULTS/$CONFIG-perf.csv" "$RESULTS/$CONFIG"-*.sca
+
+echo "Completato in $((END - START)) s: $RESULTS/$CONFIG.csv, $RESULTS/$CONFIG-perf.csv"
@@ -0,0 +1,92 @@
+// Implementazione clock locale
+#include "TDMAClock.h"
+#include <algorithm>
+
+Define_Module(TDMAClock);
+
+void TDMAClock::initialize() {
+    driftPpm = par("driftPpm").doubleValue();
+    maxDriftPpm = par("maxDriftPpm").doubleValue();
+    syncEnabled = par("syncEnabled");
+    syncInterval = par("syncInterval");
+    rateCorrection = par("rateCorrection");
+    rateErrorPpm = par("rateErrorPpm").doubleValue();
+    pathPrecision = par("syncPrecision").doubleValue() * std::max(1, (int)par("hopsFromGrandmaster").intValue());
+
+    if (fabs(driftPpm) > maxDriftPpm) {
+        throw cRuntimeError("driftPpm=%g oltre maxDriftPpm=%g", driftPpm, maxDriftPpm);
+    }
+
+    syncCount = 0;
+    maxClockError = 0;
+    syncTimer = nullptr;
+
+    // All'avvio il nodo si considera appena sincronizzato
+    synchronize();
+
+    if (syncEnabled) {
+        syncTimer = new cMessage("Sync");
+        scheduleAt(simTime() + syncInterval, syncTimer);
+    }
+
+    WATCH(currentDrift);
+    WATCH(offsetAtSync);
+}
+
+void TDMAClock::handleMessage(cMessage *msg) {
+    if (msg == syncTimer) {
+        // Errore accumulato appena prima della correzione
+        simtime_t err = fabs(getLocalTime(simTime()) - simTime());
+        if (err > maxClockError) maxClockError = err;
+
+        synchronize();
+        scheduleAt(simTime() + syncInterval, syncTimer);
+    }
+}
+
+void TDMAClock::synchronize() {
+    offsetAtSync = uniform(-0.5, 0.5) * pathPrecision.dbl();
+    lastSync = simTime();
+
+    // Con rateRatio il drift residuo e' limitato a rateErrorPpm
+    if (syncEnabled && rateCorrection) {
+        double residual = std::min(rateErrorPpm, fabs(driftPpm));
+        currentDrift = uniform(-residual, residual) * 1e-6;
+    } else {
+        currentDrift = driftPpm * 1e-6;
+    }
+    syncCount++;
+}
+
+simtime_t TDMAClock::getLocalTime(simtime_t t) const {
+    return t + offsetAtSync + (t - lastSync) * currentDrift;
+}
+
+simtime_t TDMAClock::toSimTime(simtime_t localTime) const {
+    return lastSync + (localTime - lastSync - offsetAtSync) / (1.0 + currentDrift);
+}
+
+simtime_t TDMAClock::errorBound(cModule *clockModule) {
+    if (!clockModule->par("syncEnabled").boolValue()) {
+        return SIMTIME_MAX;  // Clock libero: errore non limitato
+    }
+    int hops = std::max(1, (int)clockModule->par("hopsFromGrandmaster").intValue());
+    double precision = clockModule->par("syncPrecision").doubleValue() * hops;
+    double drift = clockModule->par("rateCorrection").boolValue()
+                   ? std::min(clockModule->par("rateErrorPpm").doubleValue(),
+                              clockModule->par("maxDriftPpm").doubleValue())
+                   : clockModule->par("maxDriftPpm").doubleValue();
+    double interval = clockModule->par("syncInterval").doubleValue();
+    return SimTime(precision / 2 + drift * 1e-6 * interval);
+}
+
+void TDMAClock::visitCycle(tdma::CycleTracker& t) {
+    t.counter(syncCount);
+    t.state(maxClockError.dbl());
+}
+
+void TDMAClock::finish() {
+    recordScalar("syncCount", syncCount);
+    recordScalar("maxClockError", maxClockError);
+    cancelAndDelete(syncTimer);
+}
@@ -0,0 +1,45 @@
+#ifndef TDMA_CLOCK_H
+#define TDMA_CLOCK_H
+
+#include <omnetpp.h>
+#include "../common/SteadyState.h"
+
+using namespace omnetpp;
+
+// Clock locale: local(t) = t + offset + drift * (t - lastSync)
+// Ad ogni Sync l'offset viene riportato entro la precisione del percorso dal grandmaster
+class TDMAClock : public cSimpleModule, public tdma::SteadyStateParticipant {
+public:
+    simtime_t getLocalTime(simtime_t t) const;
+    simtime_t toSimTime(simtime_t localTime) const;  // Istante reale in cui il clock segna localTime
+
+    // Massimo |local - reale| garantito dai parametri (usato per le guard band)
+    static simtime_t errorBound(cModule *clockModule);
+
+protected:
+    double driftPpm;
+    double maxDriftPpm;
+    bool syncEnabled;
+    simtime_t syncInterval;
+    simtime_t pathPrecision;     // syncPrecision * hop dal grandmaster
+    bool rateCorrection;
+    double rateErrorPpm;
+
+    double currentDrift;         // Errore di frequenza attuale (adimensionale)
+    simtime_t offsetAtSync;
+    simtime_t lastSync;
+    cMessage *syncTimer;
+
+    long syncCount;
+    simtime_t maxClockError;
+
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    virtual void visitCycle(tdma::CycleTracker& t) override;
+
+private:
+    void synchronize();
+};
+
+#endif
@@ -11,12 +11,31 @@ namespace tdma {
 
 // Parametri di rete fissi
 const int MTU_BYTES = 1500;           // Maximum Transmission Unit Ethernet
+const int JUMBO_MTU_BYTES = 9000;     // Jumbo frame: MTU massima accettata per un link
 const int ETHERNET_OVERHEAD = 38;     // Preamble(7) + SFD(1) + Header(14) + FCS(4) + IFG(12)
-const double DATARATE = 1e9;          // 1 Gbps
+const double DATARATE = 1e9;          // 1 Gbps (fallback per link senza DatarateChannel)
 
-// Inter-Frame Gap: 96 bit time @ 1Gbps = 96ns
-inline omnetpp::simtime_t getIfgTime() { 
-    return omnetpp::SimTime(96.0 / DATARATE); 
+// Classi di traffico: 0=Safety, 1=Control, 2=Infotainment, 3=BestEffort
+const int NUM_TRAFFIC_CLASSES = 4;
+
+// Inter-Frame Gap: 96 bit time (96ns @ 1Gbps)
+inline omnetpp::simtime_t getIfgTime(double datarate = DATARATE) { 
+    return omnetpp::SimTime(96.0 / datarate); 
+}
+
+// Datarate del canale di trasmissione collegato a un gate di uscita.
+// Legge il parametro del canale, quindi e' valido anche prima della sua initialize()
+inline double getLinkDatarate(omnetpp::cGate *outGate, double fallback = DATARATE) {
+    omnetpp::cChannel *ch = outGate ? outGate->findTransmissionChannel() : nullptr;
+    if (ch && ch->hasPar("datarate")) return ch->par("datarate").doubleValue();
+    return fallback;
+}
+
+// MTU del link (byte di payload per frame): parametro mtu del canale, MTU_BYTES se assente
+inline int getLinkMtu(omnetpp::cGate *outGate, int fallback = MTU_BYTES) {
+    omnetpp::cChannel *ch = outGate ? outGate->findTransmissionChannel() : nullptr;
+    if (ch && ch->hasPar("mtu")) return ch->par("mtu").intValue();
+    return fallback;
 }
 
 }
@@ -0,0 +1,146 @@
+/*
+ * Credit-based shaper IEEE 802.1Qav di una classe su una porta di uscita
+ * Il credito cresce a idleSlope mentre la classe attende (anche durante trasmissioni di
+ * altre classi) e cala a sendSlope = idleSlope - velocita' porta mentre trasmette; a coda
+ * vuota il credito positivo si azzera. Nelle finestre riservate TDMA la porta e' chiusa per
+ * la classe e il credito resta congelato (802.1Qbv + Qav). Aggiornato solo agli eventi della porta
+ */
+#ifndef TDMA_CREDIT_SHAPER_H
+#define TDMA_CREDIT_SHAPER_H
+
+#include <omnetpp.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "GateSchedule.h"
+#include "LogHistogram.h"
+#include "SteadyState.h"
+
+namespace tdma {
+
+class CreditShaper {
+public:
+    // Statistiche di accodamento della classe
+    long frames = 0;
+    long creditWaits = 0;       // Frame trattenuti in testa per credito negativo (una volta per frame)
+    long dropped = 0;           // Frame piu' lunghi di ogni intervallo libero
+    long maxQueue = 0;
+    double minCredit = 0;       // bit
+    LogHistogram delay;         // Ingresso in coda -> inizio TX
+
+    void configure(double slope, double portRate) {
+        idleSlope = slope;
+        sendSlope = slope - portRate;
+    }
+
+    // Senza idleSlope la classe e' solo a priorita' stretta
+    bool enabled() const { return idleSlope > 0; }
+    double getIdleSlope() const { return idleSlope; }
+
+    // Porta il credito a now; backlogged = coda della classe non vuota dall'ultimo aggiornamento.
+    // Il credito cresce solo nel tempo a porta aperta (fuori dalle finestre di gates)
+    void advance(omnetpp::simtime_t now, bool backlogged, const GateSchedule& gates) {
+        omnetpp::simtime_t from = lastUpdate;
+        lastUpdate = now;
+        if (!enabled()) return;
+        if (transmitting) {
+            credit += sendSlope * (now - from).dbl();
+        } else {
+            double open = (now - from - gates.closedTime(from, now)).dbl();
+            if (backlogged) {
+                credit += idleSlope * open;
+            } else {
+                credit = std::min(0.0, credit + idleSlope * open);
+            }
+        }
+        minCredit = std::min(minCredit, credit);
+    }
+
+    // Tolleranza per l'arrotondamento del risveglio alla risoluzione di SimTime
+    bool eligible() const { return !enabled() || credit >= -1e-2; }
+
+    // Istante in cui il credito torna a zero (dopo advance, classe in attesa)
+    omnetpp::simtime_t readyAt(omnetpp::simtime_t now) const {
+        if (eligible()) return now;
+        return now + omnetpp::SimTime(-credit / idleSlope);
+    }
+
+    // Frame in testa trattenuto per credito: contato una sola volta anche se rivalutato
+    void creditWait() {
+        if (!headWaiting) creditWaits++;
+        headWaiting = true;
+    }
+
+    void drop() {
+        dropped++;
+        headWaiting = false;
+    }
+
+    void startTx(omnetpp::simtime_t now, omnetpp::simtime_t queuedAt, const GateSchedule& gates) {
+        advance(now, true, gates);
+        transmitting = true;
+        headWaiting = false;
+        frames++;
+        delay.collect(now - queuedAt);
+    }
+
+    void endTx(omnetpp::simtime_t now, bool backlogged, const GateSchedule& gates) {
+        advance(now, true, gates);
+        transmitting = false;
+        if (!backlogged && credit > 0) credit = 0;
+    }
+
+    void visitCycle(CycleTracker& t) {
+        t.counter(frames);
+        t.counter(creditWaits);
+        t.counter(dropped);
+        t.histogram(delay);
+        t.state(maxQueue);
+        t.state(std::round(credit));
+        t.state(transmitting);
+        t.state(headWaiting);
+    }
+
+    void record(omnetpp::cComponent *owner, const std::string& prefix) const {
+        if (frames == 0 && dropped == 0) return;
+        owner->recordScalar((prefix + "idleSlope").c_str(), idleSlope, "bps");
+        owner->recordScalar((prefix + "frames").c_str(), frames);
+        owner->recordScalar((prefix + "creditWaits").c_str(), creditWaits);
+        owner->recordScalar((prefix + "dropped").c_str(), dropped);
+        owner->recordScalar((prefix + "maxQueue").c_str(), maxQueue);
+        owner->recordScalar((prefix + "minCredit").c_str(), minCredit, "b");
+        delay.recordScalars(owner, prefix + "delay");
+    }
+
+    // Formato "classe:bps;classe:bps" -> idleSlope per classe (0 = non configurata)
+    static std::vector<double> parseSlopes(const std::string& spec) {
+        std::vector<double> slopes(NUM_TRAFFIC_CLASSES, 0.0);
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ';')) {
+            size_t sep = item.find(':');
+            if (sep == std::string::npos) continue;
+            int cls = std::stoi(item.substr(0, sep));
+            if (cls < 0 || cls >= NUM_TRAFFIC_CLASSES) {
+                throw omnetpp::cRuntimeError("cbsIdleSlopes: classe %d inesistente", cls);
+            }
+            slopes[cls] = std::stod(item.substr(sep + 1));
+        }
+        return slopes;
+    }
+
+private:
+    double idleSlope = 0;       // bps riservati alla classe
+    double sendSlope = 0;       // bps, negativo
+    double credit = 0;          // bit
+    bool transmitting = false;
+    bool headWaiting = false;   // Frame in testa gia' contato in creditWaits
+    omnetpp::simtime_t lastUpdate;
+};
+
+}
+
+#endif
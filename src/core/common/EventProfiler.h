@@ -0,0 +1,141 @@
+/*
+ * Profiler degli eventi per tipo di modulo e tipo di messaggio
+ * Opzionale (profileEvents): disattivo costa un confronto per evento. Attivo misura il
+ * tempo di ogni handleMessage con steady_clock; la voce e' risolta una volta per gate di
+ * arrivo o timer del modulo (ModuleCache), poi nessuna stringa ne' mappa per evento. La
+ * tabella ordinata per tempo totale e' stampata quando l'ultimo modulo profilato esegue
+ * finish(); alla distruzione della rete (anche dopo un errore) lo stato e' azzerato
+ */
+#ifndef TDMA_EVENT_PROFILER_H
+#define TDMA_EVENT_PROFILER_H
+
+#include <omnetpp.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tdma {
+
+class EventProfiler : public omnetpp::cISimulationLifecycleListener {
+public:
+    struct Entry {
+        long events = 0;
+        double seconds = 0;
+    };
+
+    // Voci gia' risolte di un modulo: per id del gate di arrivo e per nome del timer
+    struct ModuleCache {
+        Entry *processFrame = nullptr;
+        std::vector<std::pair<int, Entry*>> gates;
+        std::vector<std::pair<std::string, Entry*>> timers;
+    };
+
+    // Misura l'evento in corso fino all'uscita da handleMessage (entry nullo = non profilato)
+    class Scope {
+    public:
+        explicit Scope(Entry *entry) : entry(entry) {
+            if (entry) start = std::chrono::steady_clock::now();
+        }
+        ~Scope() {
+            if (!entry) return;
+            entry->events++;
+            entry->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    private:
+        Entry *entry;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Unico per processo: in parsim ogni partizione stampa la propria tabella
+    static EventProfiler& instance() {
+        static EventProfiler profiler;
+        return profiler;
+    }
+
+    void attach() {
+        if (!listening) {
+            omnetpp::getEnvir()->addLifecycleListener(this);
+            listening = true;
+        }
+        modules++;
+    }
+
+    void detach() {
+        if (--modules > 0) return;
+        print(std::cout);
+        entries.clear();
+    }
+
+    // Tipo del messaggio: nome dei self-message (timer), "ProcessFrame" per i pacchetti
+    // rimandati a se stessi, "Rx:<gate>" per quelli ricevuti
+    Entry *entry(ModuleCache& cache, const omnetpp::cModule *module, omnetpp::cMessage *msg) {
+        if (!msg->isSelfMessage()) {
+            int gate = msg->getArrivalGateId();
+            for (const auto& known : cache.gates) {
+                if (known.first == gate) return known.second;
+            }
+            Entry *e = &entries[std::make_pair(std::string(module->getClassName()),
+                                               std::string("Rx:") + msg->getArrivalGate()->getBaseName())];
+            cache.gates.push_back({gate, e});
+            return e;
+        }
+        if (msg->isPacket()) {
+            if (!cache.processFrame) {
+                cache.processFrame = &entries[std::make_pair(std::string(module->getClassName()), std::string("ProcessFrame"))];
+            }
+            return cache.processFrame;
+        }
+        const char *name = msg->getName();
+        for (const auto& known : cache.timers) {
+            if (known.first == name) return known.second;
+        }
+        Entry *e = &entries[std::make_pair(std::string(module->getClassName()), std::string(name))];
+        cache.timers.push_back({name, e});
+        return e;
+    }
+
+    void print(std::ostream& out) const {
+        typedef std::pair<std::pair<std::string, std::string>, Entry> Row;
+        std::vector<Row> rows(entries.begin(), entries.end());
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+            return a.second.seconds > b.second.seconds;
+        });
+        double total = 0;
+        for (const auto& row : rows) total += row.second.seconds;
+
+        out << "=== Profilo eventi (tempo in handleMessage) ===" << std::endl;
+        char line[160];
+        snprintf(line, sizeof(line), "%-18s %-16s %12s %12s %7s %10s",
+                 "modulo", "messaggio", "eventi", "tempo [ms]", "quota", "ns/evento");
+        out << line << std::endl;
+        for (const auto& row : rows) {
+            const Entry& e = row.second;
+            snprintf(line, sizeof(line), "%-18s %-16s %12ld %12.3f %6.1f%% %10.0f",
+                     row.first.first.c_str(), row.first.second.c_str(), e.events, e.seconds * 1e3,
+                     total > 0 ? 100.0 * e.seconds / total : 0.0, e.events > 0 ? e.seconds * 1e9 / e.events : 0.0);
+            out << line << std::endl;
+        }
+    }
+
+protected:
+    // Rete distrutta: una run interrotta prima di finish() non lascia voci alla successiva
+    virtual void lifecycleEvent(omnetpp::SimulationLifecycleEventType eventType, omnetpp::cObject *details) override {
+        if (eventType != omnetpp::LF_PRE_NETWORK_DELETE) return;
+        modules = 0;
+        entries.clear();
+    }
+
+private:
+    bool listening = false;
+    int modules = 0;
+    std::map<std::pair<std::string, std::string>, Entry> entries;
+};
+
+}
+
+#endif
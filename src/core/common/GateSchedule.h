@@ -0,0 +1,105 @@
+/*
+ * Finestre riservate di una porta di uscita, ripetute ogni hyperperiod
+ * Usate per far uscire il traffico best-effort solo negli intervalli liberi dello schedule
+ */
+#ifndef TDMA_GATE_SCHEDULE_H
+#define TDMA_GATE_SCHEDULE_H
+
+#include <omnetpp.h>
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tdma {
+
+class GateSchedule {
+public:
+    // Formato "inizio:fine;inizio:fine;..." (offset in s nell'hyperperiod)
+    void parse(const std::string& spec, omnetpp::simtime_t period) {
+        windows.clear();
+        hyperperiod = period;
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ';')) {
+            size_t sep = item.find(':');
+            if (sep == std::string::npos) continue;
+            omnetpp::simtime_t start = omnetpp::SimTime::parse(item.substr(0, sep).c_str());
+            omnetpp::simtime_t end = omnetpp::SimTime::parse(item.substr(sep + 1).c_str());
+            if (end > start) windows.push_back({start, end});
+        }
+        std::sort(windows.begin(), windows.end());
+        if (!windows.empty() && hyperperiod <= 0) {
+            throw omnetpp::cRuntimeError("Finestre riservate senza hyperperiod");
+        }
+
+        closedPrefix.assign(1, omnetpp::SIMTIME_ZERO);
+        for (const auto& w : windows) closedPrefix.push_back(closedPrefix.back() + w.second - w.first);
+
+        maxGap = windows.empty() ? omnetpp::SIMTIME_MAX
+                                 : windows.front().first + hyperperiod - windows.back().second;
+        for (size_t i = 1; i < windows.size(); i++) {
+            maxGap = std::max(maxGap, windows[i].first - windows[i - 1].second);
+        }
+    }
+
+    bool empty() const { return windows.empty(); }
+
+    // Primo istante >= t da cui una trasmissione lunga duration termina prima della
+    // prossima finestra riservata; -1 se nessun intervallo libero e' abbastanza lungo
+    omnetpp::simtime_t nextFit(omnetpp::simtime_t t, omnetpp::simtime_t duration) const {
+        if (windows.empty()) return t;
+        if (duration > maxGap) return -1;
+
+        // Offset nel ciclo corrente; le finestre del ciclo k sono spostate di k * hyperperiod
+        int64_t period = hyperperiod.raw();
+        int64_t base = t.raw() - t.raw() % period;
+        int64_t candidate = t.raw() - base;
+        int64_t length = duration.raw();
+
+        // Prima finestra che termina dopo candidate (finestre ordinate e disgiunte)
+        size_t n = windows.size();
+        size_t i = std::lower_bound(windows.begin(), windows.end(), t - omnetpp::SimTime().setRaw(base),
+                                    [](const std::pair<omnetpp::simtime_t, omnetpp::simtime_t>& w,
+                                       omnetpp::simtime_t v) { return w.second <= v; }) - windows.begin();
+        for (size_t step = 0; step <= n; step++, i++) {
+            int64_t shift = period * (int64_t)(i / n);
+            int64_t start = windows[i % n].first.raw() + shift;
+            int64_t end = windows[i % n].second.raw() + shift;
+            if (candidate + length <= start) break;
+            if (end > candidate) candidate = end;
+        }
+        return omnetpp::SimTime().setRaw(base + candidate);
+    }
+
+    // Tempo riservato (porta chiusa per il traffico non schedulato) in [from, to)
+    omnetpp::simtime_t closedTime(omnetpp::simtime_t from, omnetpp::simtime_t to) const {
+        if (windows.empty() || to <= from) return omnetpp::SIMTIME_ZERO;
+        return closedBefore(to) - closedBefore(from);
+    }
+
+private:
+    std::vector<std::pair<omnetpp::simtime_t, omnetpp::simtime_t>> windows;
+    std::vector<omnetpp::simtime_t> closedPrefix;   // Durata delle prime k finestre
+    omnetpp::simtime_t hyperperiod;
+    omnetpp::simtime_t maxGap;
+
+    // Tempo riservato in [0, t): cicli interi piu' le finestre iniziate prima di t nel ciclo
+    omnetpp::simtime_t closedBefore(omnetpp::simtime_t t) const {
+        int64_t period = hyperperiod.raw();
+        int64_t cycles = t.raw() / period;
+        omnetpp::simtime_t offset = omnetpp::SimTime().setRaw(t.raw() - cycles * period);
+        size_t k = std::lower_bound(windows.begin(), windows.end(), offset,
+                                    [](const std::pair<omnetpp::simtime_t, omnetpp::simtime_t>& w,
+                                       omnetpp::simtime_t v) { return w.first < v; }) - windows.begin();
+        omnetpp::simtime_t closed = closedPrefix[k];
+        if (k > 0 && windows[k - 1].second > offset) closed -= windows[k - 1].second - offset;
+        return omnetpp::SimTime().setRaw(cycles * closedPrefix.back().raw()) + closed;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Istogramma a bucket logaritmici di dimensione fissa (stile HDR)
+ * Campioni quantizzati in ns: ogni ottava e' divisa in SUB_BUCKETS bucket lineari,
+ * errore relativo sui percentili < 1/SUB_BUCKETS. Memoria costante per istanza.
+ */
+#ifndef TDMA_LOG_HISTOGRAM_H
+#define TDMA_LOG_HISTOGRAM_H
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tdma {
+
+class LogHistogram {
+public:
+    static const int SUB_BITS = 4;                        // 16 bucket per ottava
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int OCTAVES = 41;                        // fino a 2^40 ns (~18 min)
+    static const int NUM_BUCKETS = OCTAVES * SUB_BUCKETS;
+    static const int NUM_COUNTERS = NUM_BUCKETS + 2;      // count, somma, bucket
+
+    LogHistogram() { clear(); }
+
+    void clear() {
+        for (int i = 0; i < NUM_BUCKETS; i++) buckets[i] = 0;
+        count = 0;
+        sumNs = 0;
+        minNs = INT64_MAX;
+        maxNs = 0;
+    }
+
+    void collect(omnetpp::simtime_t value) {
+        int64_t ns = value.inUnit(omnetpp::SIMTIME_NS);
+        if (ns < 0) ns = 0;
+        buckets[bucketIndex(ns)]++;
+        count++;
+        sumNs += ns;
+        if (ns < minNs) minNs = ns;
+        if (ns > maxNs) maxNs = ns;
+    }
+
+    int64_t getCount() const { return count; }
+    omnetpp::simtime_t getMin() const { return count ? fromNs(minNs) : omnetpp::SIMTIME_ZERO; }
+    omnetpp::simtime_t getMax() const { return fromNs(maxNs); }
+    omnetpp::simtime_t getMean() const { return count ? fromNs(sumNs / count) : omnetpp::SIMTIME_ZERO; }
+
+    // Percentile q in [0,1]: limite superiore del bucket, limitato al massimo osservato
+    omnetpp::simtime_t getPercentile(double q) const {
+        if (count == 0) return omnetpp::SIMTIME_ZERO;
+        int64_t rank = (int64_t)(q * count);
+        if (rank >= count) rank = count - 1;
+        int64_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen > rank) {
+                int64_t upper = bucketUpper(i) - 1;
+                return fromNs(upper < maxNs ? upper : maxNs);
+            }
+        }
+        return fromNs(maxNs);
+    }
+
+    // Contatori in forma piatta, per il confronto tra cicli (fast-forward)
+    void appendCounters(std::vector<double>& out) const {
+        out.push_back((double)count);
+        out.push_back((double)sumNs);
+        out.insert(out.end(), buckets, buckets + NUM_BUCKETS);
+    }
+
+    // Somma n volte un incremento nel formato di appendCounters; min/max invariati
+    void addRepeated(const double *delta, long n) {
+        count += (int64_t)(delta[0] * n);
+        sumNs += (int64_t)(delta[1] * n);
+        for (int i = 0; i < NUM_BUCKETS; i++) buckets[i] += (uint64_t)(delta[i + 2] * n);
+    }
+
+    // Scrive count/mean/p50/p99/p99.9/max come scalari "<name>_<stat>"
+    void recordScalars(omnetpp::cComponent *owner, const std::string& name) const {
+        owner->recordScalar((name + "_count").c_str(), (double)count);
+        if (count == 0) return;
+        owner->recordScalar((name + "_mean").c_str(), getMean());
+        owner->recordScalar((name + "_p50").c_str(), getPercentile(0.50));
+        owner->recordScalar((name + "_p99").c_str(), getPercentile(0.99));
+        owner->recordScalar((name + "_p999").c_str(), getPercentile(0.999));
+        owner->recordScalar((name + "_max").c_str(), getMax());
+    }
+
+    // Esporta i bucket non vuoti come cHistogram pesato (bin = bucket, valori in s)
+    void recordHistogram(omnetpp::cComponent *owner, const std::string& name) const {
+        if (count == 0) return;
+        int first = 0, last = NUM_BUCKETS - 1;
+        while (buckets[first] == 0) first++;
+        while (buckets[last] == 0) last--;
+
+        std::vector<double> edges;
+        for (int i = first; i <= last; i++) edges.push_back(bucketLower(i) * 1e-9);
+        edges.push_back(bucketUpper(last) * 1e-9);
+
+        omnetpp::cHistogram hist(name.c_str(), true);
+        hist.setBinEdges(edges);
+        for (int i = first; i <= last; i++) {
+            if (buckets[i] == 0) continue;
+            double mid = 0.5 * (bucketLower(i) + bucketUpper(i)) * 1e-9;
+            hist.collectWeighted(mid, (double)buckets[i]);
+        }
+        owner->recordStatistic(&hist, "s");
+    }
+
+private:
+    uint64_t buckets[NUM_BUCKETS];
+    int64_t count;
+    int64_t sumNs;
+    int64_t minNs;
+    int64_t maxNs;
+
+    static omnetpp::simtime_t fromNs(int64_t ns) {
+        return omnetpp::SimTime(ns, omnetpp::SIMTIME_NS);
+    }
+
+    static int msb(uint64_t v) {
+        int n = 0;
+        while (v >>= 1) n++;
+        return n;
+    }
+
+    // Ottava 0 lineare (0..SUB_BUCKETS-1 ns), poi SUB_BUCKETS bucket per potenza di 2
+    static int bucketIndex(int64_t ns) {
+        if (ns < SUB_BUCKETS) return (int)ns;
+        int m = msb((uint64_t)ns);
+        int octave = m - SUB_BITS + 1;
+        if (octave >= OCTAVES) return NUM_BUCKETS - 1;
+        int sub = (int)((ns >> (m - SUB_BITS)) & (SUB_BUCKETS - 1));
+        return octave * SUB_BUCKETS + sub;
+    }
+
+    static int64_t bucketLower(int idx) {
+        int octave = idx >> SUB_BITS;
+        int sub = idx & (SUB_BUCKETS - 1);
+        if (octave == 0) return sub;
+        return (int64_t)(SUB_BUCKETS + sub) << (octave - 1);
+    }
+
+    static int64_t bucketUpper(int idx) {
+        int octave = idx >> SUB_BITS;
+        if (octave == 0) return bucketLower(idx) + 1;
+        return bucketLower(idx) + ((int64_t)1 << (octave - 1));
+    }
+};
+
+}
+
+#endif
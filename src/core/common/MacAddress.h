@@ -0,0 +1,61 @@
+/*
+ * Indirizzi MAC a 48 bit come interi
+ * I frame e le tabelle degli switch usano il valore numerico; la forma
+ * "xx:xx:xx:xx:xx:xx" serve solo per parametri e log
+ */
+#ifndef TDMA_MAC_ADDRESS_H
+#define TDMA_MAC_ADDRESS_H
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace tdma {
+
+const uint64_t MAC_UNSPECIFIED = 0;
+const uint64_t MAC_MASK = 0xFFFFFFFFFFFFULL;
+const uint64_t MAC_GROUP_BIT = 0x010000000000ULL;          // Bit I/G del primo ottetto
+const uint64_t MAC_MULTICAST_BASE = 0x91E0F0000000ULL;     // Intervallo MAAP (IEEE 1722)
+
+// Vuoto = MAC_UNSPECIFIED
+inline uint64_t parseMac(const std::string& text) {
+    if (text.empty()) return MAC_UNSPECIFIED;
+    uint64_t mac = 0;
+    int octets = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find_first_of(":-", pos);
+        if (end == std::string::npos) end = text.size();
+        std::string octet = text.substr(pos, end - pos);
+        char *rest = nullptr;
+        unsigned long value = strtoul(octet.c_str(), &rest, 16);
+        if (octet.empty() || octet.size() > 2 || *rest != '\0' || ++octets > 6) {
+            throw omnetpp::cRuntimeError("Indirizzo MAC non valido: '%s'", text.c_str());
+        }
+        mac = (mac << 8) | value;
+        pos = end + 1;
+    }
+    if (octets != 6) {
+        throw omnetpp::cRuntimeError("Indirizzo MAC non valido: '%s'", text.c_str());
+    }
+    return mac;
+}
+
+inline std::string formatMac(uint64_t mac) {
+    char text[18];
+    snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+             (unsigned)(mac >> 40) & 0xFF, (unsigned)(mac >> 32) & 0xFF, (unsigned)(mac >> 24) & 0xFF,
+             (unsigned)(mac >> 16) & 0xFF, (unsigned)(mac >> 8) & 0xFF, (unsigned)mac & 0xFF);
+    return text;
+}
+
+inline bool isMulticast(uint64_t mac) { return (mac & MAC_GROUP_BIT) != 0; }
+
+// Gruppo multicast di un flusso: un indirizzo per flowIndex
+inline uint64_t multicastGroup(int flowIndex) { return (MAC_MULTICAST_BASE + flowIndex) & MAC_MASK; }
+
+}
+
+#endif
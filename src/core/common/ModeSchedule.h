@@ -0,0 +1,101 @@
+/*
+ * Cambi di modo operativo distribuiti dallo scheduler
+ * Ogni modulo riceve le proprie tabelle per modo e la lista (ciclo, modo, istante della
+ * richiesta): il cambio avviene localmente al confine di hyperperiod. Una richiesta a
+ * runtime estende la lista (update) senza toccare i cambi gia' applicati
+ */
+#ifndef TDMA_MODE_SCHEDULE_H
+#define TDMA_MODE_SCHEDULE_H
+
+#include <omnetpp.h>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tdma {
+
+class ModeSchedule {
+public:
+    // Formato "ciclo:modo[:richiesta],..." con cicli strettamente crescenti, richiesta in s
+    void parse(const std::string& spec) {
+        switches = parseSwitches(spec);
+        next = 0;
+    }
+
+    // Lista estesa a runtime: i cambi gia' applicati devono restare invariati
+    void update(const std::string& spec) {
+        std::vector<Switch> updated = parseSwitches(spec);
+        bool consistent = updated.size() >= next;
+        for (size_t i = 0; consistent && i < next; i++) {
+            consistent = updated[i].cycle == switches[i].cycle && updated[i].mode == switches[i].mode;
+        }
+        if (!consistent) {
+            throw omnetpp::cRuntimeError("modeSwitches: modificati cambi di modo gia' applicati");
+        }
+        switches.swap(updated);
+    }
+
+    bool empty() const { return switches.empty(); }
+
+    // Primo ciclo con un cambio non ancora applicato (-1 = nessuno)
+    long nextCycle() const { return next < switches.size() ? switches[next].cycle : -1; }
+
+    // Applica i cambi con ciclo <= cycle; true se mode e' cambiato
+    bool advance(long cycle, int& mode) {
+        int previous = mode;
+        while (next < switches.size() && switches[next].cycle <= cycle) {
+            mode = switches[next++].mode;
+        }
+        return mode != previous;
+    }
+
+    // Istante della richiesta dell'ultimo cambio applicato (-1 = non noto)
+    omnetpp::simtime_t lastRequest() const { return next > 0 ? switches[next - 1].requestedAt : omnetpp::SimTime(-1); }
+
+    // Tabelle per modo separate da '|'
+    static std::vector<std::string> splitModes(const std::string& spec) {
+        std::vector<std::string> tables;
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, '|')) tables.push_back(item);
+        if (!spec.empty() && spec.back() == '|') tables.push_back("");
+        return tables;
+    }
+
+private:
+    struct Switch {
+        long cycle;
+        int mode;
+        omnetpp::simtime_t requestedAt;
+    };
+
+    static std::vector<Switch> parseSwitches(const std::string& spec) {
+        std::vector<Switch> parsed;
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            std::vector<std::string> fields;
+            std::stringstream is(item);
+            std::string field;
+            while (std::getline(is, field, ':')) fields.push_back(field);
+            if (fields.size() < 2) continue;
+            Switch s;
+            s.cycle = std::stol(fields[0]);
+            s.mode = std::stoi(fields[1]);
+            s.requestedAt = fields.size() > 2 ? omnetpp::SimTime::parse(fields[2].c_str()) : omnetpp::SimTime(-1);
+            if (!parsed.empty() && s.cycle <= parsed.back().cycle) {
+                throw omnetpp::cRuntimeError("modeSwitches non ordinati: ciclo %ld dopo %ld", s.cycle, parsed.back().cycle);
+            }
+            parsed.push_back(s);
+        }
+        return parsed;
+    }
+
+    std::vector<Switch> switches;
+    size_t next = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Statistiche per porta di uscita a contatori fissi
+ * Utilizzo (tempo occupato), tempo di permanenza in coda, frame/byte per classe di traffico
+ */
+#ifndef TDMA_PORT_STATS_H
+#define TDMA_PORT_STATS_H
+
+#include <omnetpp.h>
+#include <string>
+#include "Constants.h"
+#include "LogHistogram.h"
+#include "SteadyState.h"
+
+namespace tdma {
+
+struct PortStats {
+    omnetpp::simtime_t busyTime;            // Tempo di trasmissione cumulato
+    omnetpp::simtime_t busyAtLastSample;    // Snapshot per utilizzo a intervalli
+    long frames[NUM_TRAFFIC_CLASSES];
+    long bytes[NUM_TRAFFIC_CLASSES];
+    LogHistogram residence;                 // Attesa in coda (enqueue -> inizio TX)
+    omnetpp::cOutVector *utilizationVector = nullptr;
+
+    PortStats() {
+        for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+            frames[c] = 0;
+            bytes[c] = 0;
+        }
+    }
+
+    // Chiamata all'inizio di ogni trasmissione sulla porta
+    void recordTx(int trafficClass, int64_t byteLength, omnetpp::simtime_t txTime,
+                  omnetpp::simtime_t queuedAt) {
+        if (trafficClass < 0 || trafficClass >= NUM_TRAFFIC_CLASSES)
+            trafficClass = NUM_TRAFFIC_CLASSES - 1;
+        frames[trafficClass]++;
+        bytes[trafficClass] += byteLength;
+        busyTime += txTime;
+        residence.collect(omnetpp::simTime() - queuedAt);
+    }
+
+    // Utilizzo nell'intervallo dall'ultimo campione
+    void sampleUtilization(omnetpp::simtime_t interval) {
+        if (utilizationVector && interval > 0)
+            utilizationVector->record((busyTime - busyAtLastSample) / interval);
+        busyAtLastSample = busyTime;
+    }
+
+    // Contatori per il confronto tra hyperperiod (fast-forward)
+    void visitCycle(CycleTracker& t) {
+        for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+            t.counter(frames[c]);
+            t.counter(bytes[c]);
+        }
+        t.counter(busyTime);
+        t.counter(busyAtLastSample);
+        t.histogram(residence);
+    }
+
+    long totalFrames() const {
+        long n = 0;
+        for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) n += frames[c];
+        return n;
+    }
+
+    void record(omnetpp::cComponent *owner, const std::string& prefix,
+                omnetpp::simtime_t elapsed) const {
+        if (totalFrames() == 0) return;
+        owner->recordScalar((prefix + "utilization").c_str(),
+                            elapsed > 0 ? busyTime / elapsed : 0.0);
+        owner->recordScalar((prefix + "busyTime").c_str(), busyTime);
+        for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+            if (frames[c] == 0) continue;
+            std::string cls = prefix + "class" + std::to_string(c);
+            owner->recordScalar((cls + "_frames").c_str(), frames[c]);
+            owner->recordScalar((cls + "_bytes").c_str(), bytes[c]);
+        }
+        residence.recordScalars(owner, prefix + "residence");
+        residence.recordHistogram(owner, prefix + "residence");
+    }
+};
+
+}
+
+#endif
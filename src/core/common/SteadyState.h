@@ -0,0 +1,114 @@
+/*
+ * Regime periodico e fast-forward
+ * Ad ogni confine di hyperperiod i moduli ISteadyState confrontano l'incremento dei propri
+ * contatori con quello del ciclo precedente; quando tutti coincidono lo scheduler somma
+ * N ripetizioni dell'ultimo ciclo e chiude la simulazione
+ */
+#ifndef TDMA_STEADY_STATE_H
+#define TDMA_STEADY_STATE_H
+
+#include <omnetpp.h>
+#include <cstdint>
+#include <vector>
+#include "LogHistogram.h"
+
+namespace tdma {
+
+// Raccoglie contatori e stato di un modulo in un ordine fisso. Lo stesso visitatore del
+// modulo serve sia alla cattura (fine ciclo) sia all'estrapolazione (n * incremento)
+class CycleTracker {
+public:
+    // Contatori cumulativi: estrapolati come valore += n * incremento dell'ultimo ciclo
+    template <typename T>
+    void counter(T& x) { visit((double)x, [&x](double d, long n) { x += (T)(d * n); }); }
+    void counter(omnetpp::simtime_t& x) {
+        visit((double)x.raw(), [&x](double d, long n) { x += omnetpp::SimTime().setRaw((int64_t)(d * n)); });
+    }
+    void histogram(LogHistogram& h) {
+        if (extrapolating) {
+            h.addRepeated(&delta[cursor], repeat);
+            cursor += LogHistogram::NUM_COUNTERS;
+        } else {
+            h.appendCounters(current);
+        }
+    }
+
+    // Stato (code, massimi): deve restare identico tra i confini, non viene estrapolato
+    void state(double x) { if (!extrapolating) currentState.push_back(x); }
+
+    // Chiude la cattura del ciclo: true se incremento e stato coincidono col ciclo precedente
+    bool endCycle() {
+        bool periodic = false;
+        if (current.size() == last.size()) {
+            std::vector<double> d(current.size());
+            for (size_t i = 0; i < current.size(); i++) d[i] = current[i] - last[i];
+            periodic = hasDelta && d == delta && currentState == lastState;
+            delta.swap(d);
+            hasDelta = true;
+        } else {
+            hasDelta = false;   // Nuovi flussi/porte registrati nel ciclo
+        }
+        last.swap(current);
+        lastState.swap(currentState);
+        current.clear();
+        currentState.clear();
+        return periodic;
+    }
+
+    void beginExtrapolation(long n) { extrapolating = true; repeat = n; cursor = 0; }
+    void endExtrapolation() { extrapolating = false; }
+
+private:
+    std::vector<double> current, last, delta;
+    std::vector<double> currentState, lastState;
+    bool hasDelta = false;
+    bool extrapolating = false;
+    long repeat = 0;
+    size_t cursor = 0;
+
+    template <typename Apply>
+    void visit(double value, Apply apply) {
+        if (extrapolating) apply(delta[cursor++], repeat);
+        else current.push_back(value);
+    }
+};
+
+// Modulo con statistiche estrapolabili in regime periodico
+class ISteadyState {
+public:
+    virtual ~ISteadyState() {}
+
+    // Confine di hyperperiod: true se l'ultimo ciclo ripete il precedente
+    virtual bool captureCycle() = 0;
+
+    // Aggiunge cycles ripetizioni dell'ultimo ciclo; skipped = tempo non simulato
+    virtual void extrapolateCycles(long cycles, omnetpp::simtime_t skipped) = 0;
+};
+
+// Implementazione comune: il modulo elenca contatori e stato in visitCycle()
+class SteadyStateParticipant : public ISteadyState {
+public:
+    virtual bool captureCycle() override {
+        visitCycle(cycleTracker);
+        return cycleTracker.endCycle();
+    }
+
+    virtual void extrapolateCycles(long cycles, omnetpp::simtime_t skipped) override {
+        cycleTracker.beginExtrapolation(cycles);
+        visitCycle(cycleTracker);
+        cycleTracker.endExtrapolation();
+        fastForwarded += skipped;
+    }
+
+protected:
+    omnetpp::simtime_t fastForwarded;   // Tempo estrapolato, da sommare a simTime() in finish
+
+    virtual void visitCycle(CycleTracker& t) = 0;
+
+private:
+    CycleTracker cycleTracker;
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+// Implementazione generatore di flussi
+#include "TDMAFlowGenerator.h"
+#include <sstream>
+#include <cstdio>
+
+Define_Module(TDMAFlowGenerator);
+
+// I valori generati (MAC, nomi di moduli e flussi) non contengono virgolette
+static std::string iniString(const std::string& s) {
+    return "\"" + s + "\"";
+}
+
+void TDMAFlowGenerator::initialize() {
+    parseFlowClasses(par("flowClasses").stringValue());
+    generated = 0;
+}
+
+int TDMAFlowGenerator::generate(const ParamWriter& write) {
+    int nodesPerZone = par("nodesPerZone");
+    double crossZoneShare = par("crossZoneShare").doubleValue();
+    
+    // EndSystem in ordine di dichiarazione: la zona e' la posizione / nodesPerZone
+    std::vector<cModule*> nodes;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        if ((*it)->hasGate("ethg") && (*it)->hasPar("macAddress")) nodes.push_back(*it);
+    }
+    
+    // MAC mancanti, anche sul MAC layer (il suo valore e' gia' stato fissato dal NED)
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (std::string(nodes[i]->par("macAddress").stringValue()).empty()) {
+            std::string mac = iniString(macFor(i));
+            write(nodes[i], "macAddress", mac);
+            if (cModule *macLayer = nodes[i]->getSubmodule("mac")) {
+                write(macLayer, "macAddress", mac);
+            }
+        }
+    }
+    
+    auto zoneOf = [nodesPerZone](int i) { return nodesPerZone > 0 ? i / nodesPerZone : 0; };
+    
+    std::vector<int> receivers;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if ((int)nodes[i]->par("numReceivers") > 0) receivers.push_back(i);
+    }
+    
+    generated = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        cModule *node = nodes[i];
+        
+        for (cModule::SubmoduleIterator appIt(node); !appIt.end(); ++appIt) {
+            cModule *app = *appIt;
+            if (std::string(app->getName()) != "senderApp") continue;
+            if (!std::string(app->par("flowId").stringValue()).empty()) continue;
+            
+            // Destinazione: altra zona con probabilita' crossZoneShare, se esiste
+            bool crossZone = uniform(0, 1) < crossZoneShare;
+            std::vector<int> candidates, fallback;
+            for (int r : receivers) {
+                if (r == (int)i) continue;
+                fallback.push_back(r);
+                if ((zoneOf(r) != zoneOf(i)) == crossZone) candidates.push_back(r);
+            }
+            if (candidates.empty()) candidates = fallback;
+            if (candidates.empty()) {
+                throw cRuntimeError("Nessun EndSystem con receiver per i flussi di %s", node->getFullName());
+            }
+            cModule *dst = nodes[candidates[intuniform(0, candidates.size() - 1)]];
+            
+            const FlowClass& cls = pickClass();
+            std::string id = "gen" + std::to_string(generated) + "_p" + std::to_string(cls.priority);
+            
+            write(app, "flowId", iniString(id));
+            write(app, "srcAddr", iniString(node->par("macAddress").stringValue()));
+            write(app, "dstAddr", iniString(dst->par("macAddress").stringValue()));
+            write(app, "dstNode", iniString(dst->getFullName()));
+            write(app, "period", cls.period.str() + "s");
+            write(app, "payloadSize", std::to_string(cls.payload) + "B");
+            write(app, "burstSize", std::to_string(cls.fragments));
+            write(app, "priority", std::to_string(cls.priority));
+            generated++;
+            
+            EV_DETAIL << id << ": " << node->getFullName() << " -> " << dst->getFullName()
+                      << " ogni " << cls.period << endl;
+        }
+    }
+    
+    EV << "TDMAFlowGenerator: " << nodes.size() << " EndSystem, " << generated << " flussi" << endl;
+    return generated;
+}
+
+void TDMAFlowGenerator::finish() {
+    recordScalar("generatedFlows", generated);
+}
+
+void TDMAFlowGenerator::handleMessage(cMessage *msg) {
+    delete msg;
+}
+
+void TDMAFlowGenerator::parseFlowClasses(const char *spec) {
+    classes.clear();
+    totalWeight = 0;
+    
+    std::stringstream ss(spec);
+    std::string entry;
+    while (std::getline(ss, entry, ',')) {
+        entry.erase(0, entry.find_first_not_of(" \t"));
+        entry.erase(entry.find_last_not_of(" \t") + 1);
+        if (entry.empty()) continue;
+        
+        std::vector<std::string> fields;
+        std::stringstream es(entry);
+        std::string field;
+        while (std::getline(es, field, ':')) fields.push_back(field);
+        if (fields.size() != 5) {
+            throw cRuntimeError("flowClasses: '%s' non e' priorita':periodo:payload:frammenti:peso", entry.c_str());
+        }
+        
+        FlowClass cls;
+        cls.priority = std::stoi(fields[0]);
+        cls.period = SimTime::parse(fields[1].c_str());
+        cls.payload = std::stoi(fields[2]);
+        cls.fragments = std::stoi(fields[3]);
+        cls.weight = std::stod(fields[4]);
+        if (cls.period <= 0 || cls.payload <= 0 || cls.fragments <= 0 || cls.weight < 0) {
+            throw cRuntimeError("flowClasses: valori non validi in '%s'", entry.c_str());
+        }
+        classes.push_back(cls);
+        totalWeight += cls.weight;
+    }
+    
+    if (classes.empty() || totalWeight <= 0) {
+        throw cRuntimeError("flowClasses vuoto o con pesi nulli");
+    }
+}
+
+const TDMAFlowGenerator::FlowClass& TDMAFlowGenerator::pickClass() {
+    double x = uniform(0, totalWeight);
+    for (const auto& cls : classes) {
+        if (x < cls.weight) return cls;
+        x -= cls.weight;
+    }
+    return classes.back();
+}
+
+std::string TDMAFlowGenerator::macFor(int index) const {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s:%02X:%02X:%02X", par("macPrefix").stringValue(),
+             (index >> 16) & 0xFF, (index >> 8) & 0xFF, index & 0xFF);
+    return buf;
+}
@@ -0,0 +1,45 @@
+#ifndef TDMA_FLOW_GENERATOR_H
+#define TDMA_FLOW_GENERATOR_H
+
+#include <omnetpp.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace omnetpp;
+
+// Configura una rete generata: assegna i MAC mancanti e un flusso a ogni senderApp libero,
+// estraendo classe e destinazione con l'RNG del modulo. I valori sono scritti dallo
+// scheduler (applyParam), che li riporta anche nel configExportFile
+class TDMAFlowGenerator : public cSimpleModule {
+public:
+    // Scrittura di un parametro in sintassi ini: modulo, nome, valore
+    typedef std::function<void(cModule*, const char*, const std::string&)> ParamWriter;
+
+    // Assegna MAC e flussi tramite write; numero di flussi generati
+    int generate(const ParamWriter& write);
+
+protected:
+    struct FlowClass {
+        int priority;
+        simtime_t period;
+        int payload;
+        int fragments;
+        double weight;
+    };
+
+    std::vector<FlowClass> classes;
+    double totalWeight;
+    int generated;
+
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+private:
+    void parseFlowClasses(const char *spec);
+    const FlowClass& pickClass();
+    std::string macFor(int index) const;
+};
+
+#endif
@@ -0,0 +1,148 @@
+// Implementazione validatore schedule
+#include "ScheduleValidator.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+ScheduleValidator::ScheduleValidator(simtime_t hyperperiod, simtime_t propagationDelay,
+                                     std::function<simtime_t(const std::string&)> guardFor)
+    : hyperperiod(hyperperiod), propagationDelay(propagationDelay), guardFor(guardFor) {
+    std::fill(counts, counts + NUM_ISSUE_TYPES, 0);
+}
+
+const char *ScheduleValidator::typeName(IssueType type) {
+    switch (type) {
+        case ISSUE_OVERLAP: return "overlap";
+        case ISSUE_GUARD: return "guard";
+        case ISSUE_DEADLINE: return "deadline";
+        case ISSUE_INCOMPLETE: return "incomplete";
+        default: return "?";
+    }
+}
+
+int ScheduleValidator::validate(const std::vector<TDMAScheduler::Slot>& slots,
+                                const std::vector<ExpectedJob>& expected) {
+    issues.clear();
+    std::fill(counts, counts + NUM_ISSUE_TYPES, 0);
+
+    checkLinks(slots);
+    checkDeadlines(slots);
+    checkCompleteness(slots, expected);
+    return issues.size();
+}
+
+void ScheduleValidator::report(IssueType type, int first, int second, const std::string& detail) {
+    Issue issue;
+    issue.type = type;
+    issue.first = first;
+    issue.second = second;
+    issue.detail = detail;
+    issues.push_back(issue);
+    counts[type]++;
+}
+
+// Sweep per link sugli intervalli [offset, fine TX + guard) ordinati per inizio. Gli slot
+// che superano l'hyperperiod occupano anche l'inizio del ciclo successivo: se ne aggiunge
+// la copia spostata di -hyperperiod. Gli intervalli ancora aperti stanno in un multimap per
+// fine: ogni nuovo intervallo e' riportato con tutti quelli aperti, O(n log n + conflitti)
+void ScheduleValidator::checkLinks(const std::vector<TDMAScheduler::Slot>& slots) {
+    struct Interval {
+        simtime_t start;
+        simtime_t txEnd;
+        simtime_t end;      // Con guard
+        int slot;
+    };
+    std::map<std::string, std::vector<Interval>> perLink;
+
+    for (size_t i = 0; i < slots.size(); i++) {
+        const TDMAScheduler::Slot& slot = slots[i];
+        if (slot.link.empty()) continue;
+
+        simtime_t txEnd = slot.offset + slot.duration;
+        Interval interval = {slot.offset, txEnd, txEnd + guardFor(slot.link), (int)i};
+        std::vector<Interval>& intervals = perLink[slot.link];
+        intervals.push_back(interval);
+        if (interval.end > hyperperiod) {
+            intervals.push_back({interval.start - hyperperiod, interval.txEnd - hyperperiod,
+                                 interval.end - hyperperiod, (int)i});
+        }
+    }
+
+    for (auto& entry : perLink) {
+        std::vector<Interval>& intervals = entry.second;
+        std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) {
+            return a.start != b.start ? a.start < b.start : a.slot < b.slot;
+        });
+
+        std::set<std::pair<int, int>> reported;
+        std::multimap<simtime_t, const Interval*> open;   // Fine (guard compresa) -> intervallo
+        for (const Interval& interval : intervals) {
+            open.erase(open.begin(), open.upper_bound(interval.start));
+            for (const auto& active : open) {
+                const Interval& other = *active.second;
+                if (other.slot == interval.slot) continue;
+                std::pair<int, int> key(std::min(other.slot, interval.slot), std::max(other.slot, interval.slot));
+                if (reported.insert(key).second) {
+                    IssueType type = interval.start < other.txEnd ? ISSUE_OVERLAP : ISSUE_GUARD;
+                    report(type, key.first, key.second, entry.first);
+                }
+            }
+            open.insert({interval.end, &interval});
+        }
+    }
+}
+
+// Arrivo dopo l'ultimo hop = fine dello slot piu' tardo + propagazione: basta verificarlo
+// su ogni slot
+void ScheduleValidator::checkDeadlines(const std::vector<TDMAScheduler::Slot>& slots) {
+    for (size_t i = 0; i < slots.size(); i++) {
+        const TDMAScheduler::Slot& slot = slots[i];
+        if (slot.deadline <= 0) continue;
+        simtime_t arrival = slot.offset + slot.duration + propagationDelay;
+        if (arrival > slot.deadline) {
+            report(ISSUE_DEADLINE, i, -1, slot.link + ": arrivo " + arrival.str() + " > deadline " + slot.deadline.str());
+        }
+    }
+}
+
+// Ogni job atteso deve avere esattamente fragments slot su ogni link del percorso
+void ScheduleValidator::checkCompleteness(const std::vector<TDMAScheduler::Slot>& slots,
+                                          const std::vector<ExpectedJob>& expected) {
+    typedef std::tuple<std::string, std::string, int64_t> Key;   // (flusso, link, rilascio)
+    std::map<Key, int> placed;
+    for (const auto& slot : slots) {
+        if (!slot.link.empty()) placed[Key(slot.flowId, slot.link, slot.release.raw())]++;
+    }
+
+    for (const auto& job : expected) {
+        for (const auto& link : job.links) {
+            auto it = placed.find(Key(job.flowId, link, job.release.raw()));
+            int count = it != placed.end() ? it->second : 0;
+            if (count != job.fragments) {
+                std::ostringstream detail;
+                detail << job.flowId << " rilascio " << job.release << " su " << link << ": "
+                       << count << "/" << job.fragments << " slot";
+                report(ISSUE_INCOMPLETE, -1, -1, detail.str());
+            }
+        }
+    }
+}
+
+std::string ScheduleValidator::describe(const Issue& issue, const std::vector<TDMAScheduler::Slot>& slots) const {
+    auto slotText = [&slots](int i) {
+        const TDMAScheduler::Slot& slot = slots[i];
+        return slot.flowId + "@" + slot.offset.str() + "+" + slot.duration.str();
+    };
+
+    std::string text = std::string(typeName(issue.type)) + " ";
+    if (issue.second >= 0) {
+        text += issue.detail + ": " + slotText(issue.first) + " / " + slotText(issue.second);
+    } else if (issue.first >= 0) {
+        text += slotText(issue.first) + " " + issue.detail;
+    } else {
+        text += issue.detail;
+    }
+    return text;
+}
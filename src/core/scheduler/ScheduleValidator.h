@@ -0,0 +1,67 @@
+/*
+ * Validatore indipendente della tabella di scheduling
+ * Non usa lo stato dello scheduler: per ogni link ordina gli slot, piu' la copia spostata
+ * di un hyperperiod di quelli che lo superano, e verifica sovrapposizioni, guard, deadline
+ * e completezza dei job in O(n log n + k), k coppie in conflitto. Applicabile a schedule calcolati o importati
+ */
+#ifndef TDMA_SCHEDULE_VALIDATOR_H
+#define TDMA_SCHEDULE_VALIDATOR_H
+
+#include <omnetpp.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "TDMAScheduler.h"
+
+using namespace omnetpp;
+
+class ScheduleValidator {
+public:
+    enum IssueType {
+        ISSUE_OVERLAP,      // Trasmissioni sovrapposte sullo stesso link
+        ISSUE_GUARD,        // Distanza inferiore alla guard del link
+        ISSUE_DEADLINE,     // Arrivo dopo la deadline del job
+        ISSUE_INCOMPLETE,   // Job con slot mancanti (o in eccesso) su un link del percorso
+        NUM_ISSUE_TYPES
+    };
+
+    struct Issue {
+        IssueType type;
+        int first = -1;     // Indice nello schedule validato (-1 = nessuno)
+        int second = -1;    // Slot in conflitto con first
+        std::string detail;
+    };
+
+    // Job atteso: fragments slot su ogni link del percorso verso tutte le destinazioni
+    struct ExpectedJob {
+        std::string flowId;
+        simtime_t release;
+        int fragments;
+        std::vector<std::string> links;
+    };
+
+    ScheduleValidator(simtime_t hyperperiod, simtime_t propagationDelay,
+                      std::function<simtime_t(const std::string&)> guardFor);
+
+    // Numero di problemi trovati, elencati in getIssues()
+    int validate(const std::vector<TDMAScheduler::Slot>& slots, const std::vector<ExpectedJob>& expected);
+
+    const std::vector<Issue>& getIssues() const { return issues; }
+    int count(IssueType type) const { return counts[type]; }
+    std::string describe(const Issue& issue, const std::vector<TDMAScheduler::Slot>& slots) const;
+    static const char *typeName(IssueType type);
+
+private:
+    simtime_t hyperperiod;
+    simtime_t propagationDelay;
+    std::function<simtime_t(const std::string&)> guardFor;
+    std::vector<Issue> issues;
+    int counts[NUM_ISSUE_TYPES];
+
+    void checkLinks(const std::vector<TDMAScheduler::Slot>& slots);
+    void checkDeadlines(const std::vector<TDMAScheduler::Slot>& slots);
+    void checkCompleteness(const std::vector<TDMAScheduler::Slot>& slots, const std::vector<ExpectedJob>& expected);
+    void report(IssueType type, int first, int second, const std::string& detail);
+};
+
+#endif
@@ -1,81 +1,534 @@
 // Implementazione scheduler
 #include "TDMAScheduler.h"
+#include "ScheduleValidator.h"
 #include "../common/Constants.h" 
+#include "../common/MacAddress.h"
+#include "../clock/TDMAClock.h"
+#include "../generator/TDMAFlowGenerator.h"
 #include <algorithm>
 #include <sstream>
 #include <set>
 #include <map>
 #include <queue>
 #include <iostream>
+#include <fstream>
+#include <climits>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 Define_Module(TDMAScheduler);
 
-// Prenotazione di un link per un intervallo temporale
-struct LinkReservation {
-    simtime_t start;
-    simtime_t end;
-};
-
-// Tabella globale delle prenotazioni link
-static std::map<std::string, std::vector<LinkReservation>> linkTable;
-
 // Job da schedulare: un frammento di un flusso in una specifica istanza
 struct Job {
     std::string flowId;
+    int flowIdx;                  // Indice in flows
     std::string srcNode;
     simtime_t releaseTime;
     simtime_t deadline;
-    simtime_t txDuration;
+    simtime_t txDuration;         // Sul primo link
+    int payload;
     int fragmentIndex;
+    int priority;                 // Criticita': 0 = Safety
+    int zone;                     // Zona del flusso (-1 = backbone)
     std::vector<std::string> destinations;
 };
 
-// Verifica disponibilita link in [start, start+duration+guard]
-static bool isLinkFree(const std::string& linkId, simtime_t start, simtime_t duration, simtime_t guard) {
-    simtime_t reqEnd = start + duration + guard;
-    if (linkTable.find(linkId) == linkTable.end()) return true;
-    for (const auto& res : linkTable[linkId]) {
-        if (start < res.end && res.start < reqEnd) return false;
+// Verifica disponibilita link in [start, start+duration+guard]. Le prenotazioni di un link
+// sono ordinate e disgiunte: l'unica candidata al conflitto e' la prima che termina dopo
+// start (ricerca binaria). Se occupato, freeAt = fine della prenotazione che blocca
+bool TDMAScheduler::isLinkFree(const std::string& linkId, simtime_t start, simtime_t duration, simtime_t guard,
+                               simtime_t& freeAt) const {
+    auto it = linkTable.find(linkId);
+    if (it == linkTable.end()) return true;
+    const std::vector<LinkReservation>& reservations = it->second;
+    auto res = std::upper_bound(reservations.begin(), reservations.end(), start,
+                                [](simtime_t t, const LinkReservation& r) { return t < r.end; });
+    if (res == reservations.end() || res->start >= start + duration + guard) return true;
+    freeAt = res->end;
+    return false;
+}
+
+void TDMAScheduler::reserveLink(const std::string& linkId, simtime_t start, simtime_t duration, simtime_t guard) {
+    std::vector<LinkReservation>& reservations = linkTable[linkId];
+    auto pos = std::upper_bound(reservations.begin(), reservations.end(), start,
+                                [](simtime_t t, const LinkReservation& r) { return t < r.start; });
+    reservations.insert(pos, {start, start + duration + guard});
+}
+
+void TDMAScheduler::releaseLink(const std::string& linkId, simtime_t start) {
+    std::vector<LinkReservation>& reservations = linkTable[linkId];
+    auto pos = std::lower_bound(reservations.begin(), reservations.end(), start,
+                                [](const LinkReservation& r, simtime_t t) { return r.start < t; });
+    if (pos != reservations.end() && pos->start == start) reservations.erase(pos);
+}
+
+// Unico punto di scrittura della configurazione nei moduli: il valore e' in sintassi
+// ini, applicato con parse() e accodato all'export per le run senza scheduler
+void TDMAScheduler::applyParam(cModule *module, const char *name, const std::string& value) {
+    module->par(name).parse(value.c_str());
+    if (!configExportFile.empty()) {
+        exportedConfig << module->getFullPath() << "." << name << " = " << value << "\n";
     }
-    return true;
 }
 
-static void reserveLink(const std::string& linkId, simtime_t start, simtime_t duration, simtime_t guard) {
-    linkTable[linkId].push_back({start, start + duration + guard});
+// I valori generati (CSV di numeri, MAC, "->", ";") non contengono virgolette
+static std::string iniString(const std::string& s) {
+    return "\"" + s + "\"";
 }
 
+static std::string iniSeconds(simtime_t t) {
+    return t.str() + "s";
+}
+
+void TDMAScheduler::writeConfigExport() {
+    std::ofstream out(configExportFile);
+    if (!out) {
+        throw cRuntimeError("Impossibile scrivere configExportFile '%s'", configExportFile.c_str());
+    }
+    out << "# Configurazione generata da " << getFullPath() << " (hyperperiod " << hyperperiod << ")\n";
+    out << "# Da includere in una sezione con **.tdmaScheduler.enabled = false\n";
+    out << exportedConfig.str();
+    std::cout << "TDMA SCHEDULER: configurazione esportata in " << configExportFile << std::endl;
+}
+
+// Split lista "a,b,..." (destinazioni, modi)
+static std::vector<std::string> splitDestinations(const std::string& dst) {
+    std::vector<std::string> destinations;
+    std::stringstream ss(dst);
+    std::string d;
+    while (std::getline(ss, d, ',')) {
+        d.erase(0, d.find_first_not_of(" \t"));
+        d.erase(d.find_last_not_of(" \t") + 1);
+        if (!d.empty()) destinations.push_back(d);
+    }
+    return destinations;
+}
+
+
+// Flussi di TDMAFlowGenerator scritti con applyParam come il resto della configurazione:
+// una run con scheduler disabilitato li riceve dal configExportFile
+void TDMAScheduler::applyGeneratedFlows() {
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        TDMAFlowGenerator *generator = dynamic_cast<TDMAFlowGenerator*>(*it);
+        if (!generator) continue;
+        int generated = generator->generate([this](cModule *module, const char *name, const std::string& value) {
+            applyParam(module, name, value);
+        });
+        std::cout << "TDMA SCHEDULER: " << generated << " flussi da " << generator->getFullName() << std::endl;
+    }
+}
+
+// Nodi della rete: switch (gate "port") ed EndSystem (gate "ethg")
+static bool isNetworkNode(cModule *module) {
+    return module->hasGate("port") || module->hasGate("ethg");
+}
+
+// Nodo per nome completo, anche elemento di vettore (es. "es[12]")
+cModule *TDMAScheduler::findNode(const std::string& name) const {
+    return getParentModule()->findModuleByPath(("." + name).c_str());
+}
 
 void TDMAScheduler::initialize() {
+    wallStart = std::chrono::steady_clock::now();
+    recordPerformance = par("recordPerformance");
+    scheduleWallTime = 0;
+    cycleTimer = nullptr;
+    stopTimer = nullptr;
+    stableCycles = 0;
+    cyclesSkipped = 0;
+    steadyStateAt = -1;
+    fastForwarded = 0;
+    lastModeActivation = 0;
+    lastModeCycle = 0;
+    modeRequestsAccepted = 0;
+    modeRequestsRejected = 0;
+    modeTargets.clear();
+    jobsTotal = 0;
+    placementAttempts = 0;
+    maxAttemptsPerJob = 0;
+    failedJobs = 0;
+    criticalPriority = par("criticalPriority");
+    phaseTimes.clear();
+    linkTelemetry.clear();
+    fastForward = false;
+    analyticOnly = false;
+    
+    // Disabilitato (es. simulazione parallela): la configurazione arriva dall'ini esportato
+    if (!par("enabled").boolValue()) {
+        std::cout << "TDMA SCHEDULER: disabilitato, configurazione da ini" << std::endl;
+        return;
+    }
+    configExportFile = par("configExportFile").stringValue();
+    exportedConfig.str("");
+    
     hyperperiod = par("hyperperiod");
     datarate = par("datarate").doubleValue();
     guardTime = par("guardTime").doubleValue();
     switchDelay = par("switchDelay").doubleValue();
     propagationDelay = par("propagationDelay").doubleValue();
+    adaptiveGuard = par("adaptiveGuard");
+    grandmaster = par("grandmaster").stringValue();
+    zonalScheduling = par("zonalScheduling");
+    numZones = 0;
 
     // Reset strutture
     flows.clear();
     schedule.clear();
+    modes.clear();
+    modeSwitchConfig.clear();
+    validationIssues.assign(ScheduleValidator::NUM_ISSUE_TYPES, 0);
     linkTable.clear();
     adjacency.clear();
     nodeMacAddress.clear();
     pathCache.clear();
+    linkGuard.clear();
+    linkDatarate.clear();
+    linkMtu.clear();
+    nodeZone.clear();
+    zoneTelemetry.clear();
+    phaseStart = std::chrono::steady_clock::now();
 
     std::cout << "TDMA SCHEDULER: Inizializzazione..." << std::endl;
+    
+    // Modi operativi: vuoto = schedule unico con tutti i flussi
+    for (const auto& name : splitDestinations(par("modes").stringValue())) {
+        modes.push_back(ModeTable());
+        modes.back().name = name;
+    }
+    if (modes.empty()) modes.push_back(ModeTable());
+    if (modes.size() > 64) {
+        throw cRuntimeError("Al massimo 64 modi operativi (%d)", (int)modes.size());
+    }
 
+    // MAC e flussi delle reti generate, prima che la discovery li legga
+    applyGeneratedFlows();
+    endPhase("applyGeneratedFlows");
+    
     // Discovery topologia dalla rete NED
     discoverTopology();
+    endPhase("discoverTopology");
     
     // Leggo configurazione flussi
     discoverFlowsFromNetwork();
+    endPhase("discoverFlowsFromNetwork");
+    if (zonalScheduling) {
+        assignZones();
+        endPhase("assignZones");
+    }
     
-    // Calcolo tabella di scheduling
-    generateOptimizedSchedule();
+    // Guard band dalla precisione di sincronizzazione
+    computeGuardBands();
+    endPhase("computeGuardBands");
+    
+    // Una tabella per modo, tutte calcolate ora (o importate): a runtime i moduli cambiano solo tabella
+    std::string importFile = par("scheduleImportFile").stringValue();
+    if (!importFile.empty()) {
+        importSchedule(importFile);
+        endPhase("importSchedule");
+    }
+    for (size_t m = 0; m < modes.size(); m++) {
+        ModeTable& mode = modes[m];
+        if (importFile.empty()) {
+            schedule.clear();
+            linkTable.clear();
+            generateOptimizedSchedule(m);
+            endPhase("generateOptimizedSchedule");
+            mode.schedule.swap(schedule);
+            mode.linkTable.swap(linkTable);
+        }
+        
+        for (const auto& entry : mode.linkTable) {
+            for (const auto& res : entry.second) {
+                if (res.end > hyperperiod) mode.spilledReservations++;
+            }
+        }
+        if (modes.size() > 1) {
+            std::cout << "TDMA SCHEDULER: modo " << mode.name << " - " << mode.schedule.size() << " slot" << std::endl;
+            // Solo da schedule importati: quelli calcolati rifiutano i job che sforano
+            if (mode.spilledReservations > 0) {
+                throw cRuntimeError("Modo %s: %d prenotazioni oltre l'hyperperiod, il cambio modo non sarebbe hitless",
+                                    mode.name.c_str(), mode.spilledReservations);
+            }
+        }
+    }
+    if (par("validateSchedule").boolValue()) {
+        validateModes();
+        endPhase("validateModes");
+    }
+    std::string exportFile = par("scheduleExportFile").stringValue();
+    if (!exportFile.empty()) exportSchedule(exportFile);
+    resolveModeRequests();
+    computeNetworkCalculusBounds();
+    computeResponseBounds();
+    endPhase("analyticBounds");
     
     // Distribuisco configurazione
     configureSenders();
+    endPhase("configureSenders");
     configureSwitches();
+    endPhase("configureSwitches");
+    configureReceivers();
+    endPhase("configureReceivers");
+    configureGates();
+    endPhase("configureGates");
+    configureShapers();
+    configureBestEffort();
+    endPhase("configureShapersBestEffort");
+    
+    if (!configExportFile.empty()) writeConfigExport();
+    collectLinkTelemetry();
+    
+    // Controllo dopo tutti gli altri eventi del confine di hyperperiod
+    fastForward = par("fastForward");
+    steadyStateCycles = std::max(1, (int)par("steadyStateCycles").intValue());
+    // Solo limiti analitici: la simulazione termina subito dopo l'inizializzazione
+    analyticOnly = par("analyticOnly");
+    if (analyticOnly) {
+        fastForward = false;
+        stopTimer = new cMessage("AnalyticOnlyStop");
+        scheduleAt(simTime(), stopTimer);
+    }
+    if (fastForward) {
+        cycleTimer = new cMessage("SteadyStateCheck");
+        cycleTimer->setSchedulingPriority(SHRT_MAX);
+        scheduleAt(simTime() + hyperperiod, cycleTimer);
+    }
+    
+    scheduleWallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    std::cout << "TDMA SCHEDULER: Inizializzazione completata in " << scheduleWallTime << " s" << std::endl;
+    
+    std::string telemetryFile = par("telemetryFile").stringValue();
+    if (!telemetryFile.empty()) writeTelemetry(telemetryFile);
+}
+
+void TDMAScheduler::finish() {
+    if (fastForward) {
+        recordScalar("steadyStateAt", steadyStateAt);
+        recordScalar("steadyStateCyclesSkipped", cyclesSkipped);
+        recordScalar("steadyStateFastForwarded", fastForwarded);
+    }
+    for (size_t i = 0; i < validationIssues.size(); i++) {
+        recordScalar((std::string("validation_") + ScheduleValidator::typeName((ScheduleValidator::IssueType)i)).c_str(),
+                     validationIssues[i]);
+    }
+    if (modes.size() > 1) {
+        // Latenze misurate da sender, MAC e switch (statistica modeTransitionLatency)
+        recordScalar("modeRequests", modeRequestsAccepted);
+        recordScalar("modeRequestsRejected", modeRequestsRejected);
+        for (const auto& mode : modes) {
+            recordScalar(("modeSpilledReservations_" + mode.name).c_str(), mode.spilledReservations);
+        }
+    }
+    if (!phaseTimes.empty()) recordTelemetry();
+    if (recordPerformance) recordPerformanceStats();
+    cancelAndDelete(cycleTimer);
+    cancelAndDelete(stopTimer);
+    cycleTimer = stopTimer = nullptr;
+}
+
+// Tutti i moduli catturano il ciclo appena concluso (nessun short-circuit: ognuno
+// aggiorna il proprio riferimento). Dopo steadyStateCycles ripetizioni identiche gli
+// hyperperiod interi fino a sim-time-limit vengono estrapolati; il resto si simula
+void TDMAScheduler::checkSteadyState() {
+    if (participants.empty()) {
+        cSimulation *sim = getSimulation();
+        for (int id = 0; id <= sim->getLastComponentId(); id++) {
+            if (auto *p = dynamic_cast<tdma::ISteadyState*>(sim->getModule(id))) participants.push_back(p);
+        }
+    }
+    
+    bool periodic = true;
+    for (auto *p : participants) {
+        periodic = p->captureCycle() && periodic;
+    }
+    // I cambi di modo ancora da attivare renderebbero falsa l'estrapolazione
+    if (simTime() < lastModeActivation) periodic = false;
+    stableCycles = periodic ? stableCycles + 1 : 0;
+    
+    if (stableCycles < steadyStateCycles) {
+        scheduleAt(simTime() + hyperperiod, cycleTimer);
+        return;
+    }
+    
+    const char *limitStr = getEnvir()->getConfig()->getConfigValue("sim-time-limit");
+    if (!limitStr || !*limitStr) {
+        EV_WARN << "Regime periodico senza sim-time-limit: nessuna estrapolazione" << endl;
+        return;
+    }
+    simtime_t limit = SimTime::parse(limitStr);
+    simtime_t remaining = limit - simTime();
+    long cycles = remaining > 0 ? (long)floor(remaining / hyperperiod) : 0;
+    
+    steadyStateAt = simTime();
+    if (cycles > 0) {
+        fastForwarded = hyperperiod * cycles;
+        cyclesSkipped = cycles;
+        for (auto *p : participants) p->extrapolateCycles(cycles, fastForwarded);
+    }
+    std::cout << "TDMA SCHEDULER: regime periodico a " << simTime() << ", estrapolati "
+              << cycles << " hyperperiod" << std::endl;
+    
+    simtime_t rest = remaining - fastForwarded;
+    if (rest > 0) {
+        stopTimer = new cMessage("SteadyStateStop");
+        stopTimer->setSchedulingPriority(SHRT_MAX);
+        scheduleAt(simTime() + rest, stopTimer);
+    } else {
+        endSimulation();
+    }
+}
+
+void TDMAScheduler::endPhase(const char *name) {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - phaseStart).count();
+    phaseStart = now;
+    for (auto& phase : phaseTimes) {
+        if (phase.first == name) {
+            phase.second += seconds;
+            return;
+        }
+    }
+    phaseTimes.push_back({name, seconds});
+}
+
+// Utilizzo (prenotazioni senza la guard iniziale, che si sovrapporrebbe alla guard finale
+// della prenotazione precedente) e intervallo libero piu' lungo tra le finestre dei gate, per modo
+void TDMAScheduler::collectLinkTelemetry() {
+    linkTelemetry.clear();
+    for (const auto& mode : modes) {
+        for (const auto& entry : mode.linkTable) {
+            simtime_t reserved;
+            for (const auto& window : mergedWindows(entry.first, entry.second, false)) {
+                reserved += window.second - window.first;
+            }
+            std::vector<std::pair<simtime_t, simtime_t>> windows = mergedWindows(entry.first, entry.second);
+            simtime_t largestGap = windows.empty() ? hyperperiod : SIMTIME_ZERO;
+            for (size_t i = 0; i < windows.size(); i++) {
+                simtime_t next = i + 1 < windows.size() ? windows[i + 1].first : windows[0].first + hyperperiod;
+                if (next - windows[i].second > largestGap) largestGap = next - windows[i].second;
+            }
+            linkTelemetry.push_back({entry.first, mode.name, reserved / hyperperiod, largestGap});
+        }
+    }
+}
+
+void TDMAScheduler::recordTelemetry() {
+    for (const auto& phase : phaseTimes) {
+        recordScalar(("phaseTime_" + phase.first).c_str(), phase.second, "s");
+    }
+    recordScalar("jobs", jobsTotal);
+    recordScalar("failedJobs", failedJobs);
+    long rejectedJobs = 0;
+    for (const auto& mode : modes) rejectedJobs += mode.rejected.size();
+    recordScalar("rejectedJobs", rejectedJobs);
+    recordScalar("placementAttempts", placementAttempts);
+    recordScalar("placementRetries", placementAttempts - jobsTotal);
+    recordScalar("maxAttemptsPerJob", maxAttemptsPerJob);
+    if (jobsTotal > 0) recordScalar("meanAttemptsPerJob", (double)placementAttempts / jobsTotal);
+    
+    // Secondo livello: le zone sono indipendenti, zoneTimeMax e' il tempo con una zona per core
+    if (zonalScheduling) {
+        recordScalar("zones", numZones);
+        double zoneTimeMax = 0;
+        for (int z = 0; z < numZones; z++) {
+            std::string zone = std::to_string(z);
+            recordScalar(("zoneLinks_" + zone).c_str(), zoneTelemetry[z].links);
+            recordScalar(("zoneJobs_" + zone).c_str(), zoneTelemetry[z].jobs);
+            recordScalar(("zoneBudget_" + zone).c_str(), zoneTelemetry[z].budget);
+            recordScalar(("zoneTime_" + zone).c_str(), zoneTelemetry[z].seconds, "s");
+            zoneTimeMax = std::max(zoneTimeMax, zoneTelemetry[z].seconds);
+        }
+        recordScalar("zoneTimeMax", zoneTimeMax, "s");
+    }
     
-    std::cout << "TDMA SCHEDULER: Inizializzazione completata" << std::endl;
+    double maxUtilization = 0;
+    for (const auto& link : linkTelemetry) {
+        std::string name = link.link + (modes.size() > 1 ? "@" + link.mode : "");
+        recordScalar(("linkUtilization_" + name).c_str(), link.utilization);
+        recordScalar(("linkLargestGap_" + name).c_str(), link.largestGap);
+        maxUtilization = std::max(maxUtilization, link.utilization);
+    }
+    if (!linkTelemetry.empty()) recordScalar("linkUtilizationMax", maxUtilization);
+    
+    for (const auto& flow : flows) {
+        if (flow.minSlack != SIMTIME_MAX) recordScalar(("minSlack_" + flow.id).c_str(), flow.minSlack);
+        if (flow.unscheduledJobs > 0) recordScalar(("rejectedJobs_" + flow.id).c_str(), flow.unscheduledJobs);
+    }
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Riepilogo leggibile da script: stessi valori degli scalari, in un unico file per run
+void TDMAScheduler::writeTelemetry(const std::string& file) const {
+    std::ofstream out(file);
+    if (!out) {
+        throw cRuntimeError("Impossibile scrivere telemetryFile '%s'", file.c_str());
+    }
+    out.precision(12);
+    
+    out << "{\n  \"scheduleWallTime\": " << scheduleWallTime << ",\n  \"phases\": {";
+    for (size_t i = 0; i < phaseTimes.size(); i++) {
+        out << (i ? ", " : "") << jsonString(phaseTimes[i].first) << ": " << phaseTimes[i].second;
+    }
+    out << "},\n  \"jobs\": " << jobsTotal << ",\n  \"failedJobs\": " << failedJobs
+        << ",\n  \"placementAttempts\": " << placementAttempts
+        << ",\n  \"placementRetries\": " << placementAttempts - jobsTotal
+        << ",\n  \"maxAttemptsPerJob\": " << maxAttemptsPerJob << ",\n  \"links\": [";
+    for (size_t i = 0; i < linkTelemetry.size(); i++) {
+        const LinkTelemetry& link = linkTelemetry[i];
+        out << (i ? "," : "") << "\n    {\"link\": " << jsonString(link.link) << ", \"mode\": " << jsonString(link.mode)
+            << ", \"utilization\": " << link.utilization << ", \"largestGap\": " << link.largestGap.dbl() << "}";
+    }
+    out << "\n  ],\n  \"flows\": [";
+    for (size_t i = 0; i < flows.size(); i++) {
+        const Flow& flow = flows[i];
+        out << (i ? "," : "") << "\n    {\"flow\": " << jsonString(flow.id) << ", \"unscheduledJobs\": " << flow.unscheduledJobs
+            << ", \"latencyBound\": " << flow.latencyBound.dbl() << ", \"minSlack\": ";
+        if (flow.minSlack != SIMTIME_MAX) out << flow.minSlack.dbl();
+        else out << "null";
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    std::cout << "TDMA SCHEDULER: telemetria scritta in " << file << std::endl;
+}
+
+// Costo della run misurato dallo scheduler (unico per rete). Il wall time parte
+// da initialize() dello scheduler: esclude caricamento NED e costruzione della rete
+void TDMAScheduler::recordPerformanceStats() {
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    double runWall = wall - scheduleWallTime;
+    int64_t events = getSimulation()->getEventNumber();
+    simtime_t simulated = simTime() + fastForwarded;   // Tempo coperto, incluso l'estrapolato
+    
+    recordScalar("perfWallTime", wall, "s");
+    recordScalar("perfScheduleWallTime", scheduleWallTime, "s");
+    recordScalar("perfEvents", (double)events);
+    if (runWall > 0) {
+        recordScalar("perfEventsPerSec", events / runWall);
+        recordScalar("perfSimSecPerSec", simulated.dbl() / runWall);
+    }
+    
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        double peakRss = usage.ru_maxrss;            // byte
+#else
+        double peakRss = usage.ru_maxrss * 1024.0;   // KiB su Linux
+#endif
+        recordScalar("perfPeakRss", peakRss, "B");
+    }
+#endif
+    
+    EV << "Performance: " << events << " eventi in " << wall << " s" << endl;
 }
 
 void TDMAScheduler::discoverTopology() {
@@ -86,10 +539,10 @@ void TDMAScheduler::discoverTopology() {
     // Raccogli tutti i nodi e i loro MAC address
     for (cModule::SubmoduleIterator it(network); !it.end(); ++it) {
         cModule *node = *it;
-        std::string nodeName = node->getName();
+        std::string nodeName = node->getFullName();
         
-        // Salta lo scheduler stesso
-        if (nodeName == "tdmaScheduler") continue;
+        // Solo switch ed EndSystem (salta scheduler, generatore di flussi, ...)
+        if (!isNetworkNode(node)) continue;
         
         // Raccogli MAC address dagli EndSystem
         if (node->hasPar("macAddress")) {
@@ -117,9 +570,9 @@ void TDMAScheduler::discoverTopology() {
     // Scopri le connessioni navigando le gate
     for (cModule::SubmoduleIterator it(network); !it.end(); ++it) {
         cModule *node = *it;
-        std::string nodeName = node->getName();
+        std::string nodeName = node->getFullName();
         
-        if (nodeName == "tdmaScheduler") continue;
+        if (!isNetworkNode(node)) continue;
         
         // Controlla se e' uno switch (lo riconosco perche' ha gate array "port")
         bool isSwitch = (nodeName.find("switch") != std::string::npos);
@@ -138,9 +591,13 @@ void TDMAScheduler::discoverTopology() {
                             cModule *rawNeighbor = destGate->getOwnerModule();
                             cModule *neighbor = getNetworkModule(rawNeighbor);
                             if (neighbor && neighbor != node) {
-                                std::string neighborName = neighbor->getName();
+                                std::string neighborName = neighbor->getFullName();
                                 adjacency[nodeName].push_back({neighborName, p});
-                                EV << "Connessione: " << nodeName << "[" << p << "] -> " << neighborName << endl;
+                                double rate = tdma::getLinkDatarate(outGate, datarate);
+                                linkDatarate[nodeName + "->" + neighborName] = rate;
+                                linkMtu[nodeName + "->" + neighborName] = tdma::getLinkMtu(outGate);
+                                EV << "Connessione: " << nodeName << "[" << p << "] -> " << neighborName
+                                   << " @ " << rate / 1e6 << " Mbps" << endl;
                             }
                         }
                     }
@@ -155,9 +612,13 @@ void TDMAScheduler::discoverTopology() {
                     cModule *rawNeighbor = destGate->getOwnerModule();
                     cModule *neighbor = getNetworkModule(rawNeighbor);
                     if (neighbor && neighbor != node) {
-                        std::string neighborName = neighbor->getName();
+                        std::string neighborName = neighbor->getFullName();
                         adjacency[nodeName].push_back({neighborName, 0});
-                        EV << "Connessione: " << nodeName << " -> " << neighborName << endl;
+                        double rate = tdma::getLinkDatarate(outGate, datarate);
+                        linkDatarate[nodeName + "->" + neighborName] = rate;
+                        linkMtu[nodeName + "->" + neighborName] = tdma::getLinkMtu(outGate);
+                        EV << "Connessione: " << nodeName << " -> " << neighborName
+                           << " @ " << rate / 1e6 << " Mbps" << endl;
                     }
                 }
             }
@@ -189,14 +650,65 @@ void TDMAScheduler::discoverFlowsFromNetwork() {
 
                 Flow flow;
                 flow.id = fid;
-                flow.src = node->getName();
+                flow.index = flows.size();
+                flow.src = node->getFullName();
                 flow.srcMac = app->par("srcAddr").stringValue();
                 flow.dstMac = app->par("dstAddr").stringValue();
                 
                 flow.payload = app->par("payloadSize").intValue();
+                flow.lastPayload = flow.payload;
+                flow.messageSize = app->par("messageSize").intValue();
                 flow.period = SimTime(app->par("period").doubleValue());
                 flow.fragmentCount = app->par("burstSize").intValue();
+                flow.messageFragments = flow.fragmentCount;
                 flow.isFragmented = flow.fragmentCount > 1;
+                flow.priority = app->par("priority").intValue();
+                
+                std::string shaping = app->par("shaping").stringValue();
+                if (shaping != "tdma" && shaping != "cbs") {
+                    throw cRuntimeError("Flow %s: shaping '%s' non valido (tdma o cbs)", fid.c_str(), shaping.c_str());
+                }
+                flow.shaped = shaping == "cbs";
+                
+                // Sporadico: job del server ogni serverPeriod, con budget sufficiente per gli
+                // eventi che possono arrivare in un periodo al minimo interarrivo
+                flow.sporadic = app->par("sporadic").boolValue();
+                if (flow.sporadic) {
+                    if (flow.shaped) {
+                        throw cRuntimeError("Flow %s: un flusso sporadico usa gli slot del server, non shaping cbs", fid.c_str());
+                    }
+                    flow.minInterArrival = app->par("minInterArrival");
+                    if (flow.minInterArrival <= 0) {
+                        throw cRuntimeError("Flow %s: minInterArrival deve essere positivo", fid.c_str());
+                    }
+                    simtime_t serverPeriod = app->par("serverPeriod");
+                    flow.period = serverPeriod > 0 ? serverPeriod : flow.minInterArrival;
+                    flow.serverBudget = (int)ceil(flow.period / flow.minInterArrival);
+                    flow.fragmentCount *= flow.serverBudget;
+                    flow.isFragmented = flow.fragmentCount > 1;
+                }
+                
+                // Deadline di piazzamento: maxLatency vincola la deadline sotto il periodo
+                simtime_t maxLatency = app->par("maxLatency");
+                if (maxLatency < 0) {
+                    throw cRuntimeError("Flow %s: maxLatency negativa", fid.c_str());
+                }
+                flow.relativeDeadline = (maxLatency > 0 && maxLatency < flow.period) ? maxLatency : flow.period;
+                
+                // Modi del flusso (vuoto = tutti)
+                std::vector<std::string> flowModes = splitDestinations(app->par("modes").stringValue());
+                if (!flowModes.empty()) {
+                    flow.modeMask = 0;
+                    for (const auto& name : flowModes) {
+                        size_t m = 0;
+                        while (m < modes.size() && modes[m].name != name) m++;
+                        if (m == modes.size()) {
+                            throw cRuntimeError("Flow %s: modo '%s' non definito in tdmaScheduler.modes",
+                                                fid.c_str(), name.c_str());
+                        }
+                        flow.modeMask |= 1ULL << m;
+                    }
+                }
 
                 // Gestione Destinazione (Multicast vs Unicast)
                 if (app->hasPar("destinations") && std::string(app->par("destinations").stringValue()) != "") {
@@ -208,6 +720,15 @@ void TDMAScheduler::discoverFlowsFromNetwork() {
                     flow.dst = "UNKNOWN";
                 }
 
+                // Multicast: gruppo MAC proprio del flusso, scritto nel dstAddr del sender
+                if (flow.dstMac == "multicast" || splitDestinations(flow.dst).size() > 1) {
+                    flow.dstMac = tdma::formatMac(tdma::multicastGroup(flow.index));
+                } else {
+                    tdma::parseMac(flow.dstMac);    // Errore subito se il MAC non e' valido
+                }
+                
+                if (flow.messageSize > 0) fragmentMessage(flow);
+
                 flows.push_back(flow);
                 EV << "Flow: " << flow.id << " [" << flow.src 
                    << " -> " << flow.dst << "] Period:" << flow.period << endl;
@@ -218,6 +739,61 @@ void TDMAScheduler::discoverFlowsFromNetwork() {
     std::cout << "TDMA SCHEDULER: " << flows.size() << " flussi trovati" << std::endl;
 }
 
+// Zona di ogni nodo: parametro zone degli switch (-1 = zona propria), EndSystem nella zona
+// dello switch di accesso. Un flusso e' locale se tutti i nodi dei suoi percorsi sono nella
+// stessa zona, altrimenti usa il backbone (zone = -1)
+void TDMAScheduler::assignZones() {
+    std::vector<std::string> unzoned;
+    for (const auto& entry : adjacency) {
+        if (entry.first.find("switch") == std::string::npos) continue;
+        cModule *sw = findNode(entry.first);
+        int zone = (sw && sw->hasPar("zone")) ? sw->par("zone").intValue() : -1;
+        if (zone >= 0) {
+            nodeZone[entry.first] = zone;
+            numZones = std::max(numZones, zone + 1);
+        } else {
+            unzoned.push_back(entry.first);
+        }
+    }
+    for (const auto& name : unzoned) nodeZone[name] = numZones++;
+    
+    for (const auto& entry : adjacency) {
+        if (nodeZone.count(entry.first) || entry.second.empty()) continue;
+        auto it = nodeZone.find(entry.second[0].first);
+        if (it != nodeZone.end()) nodeZone[entry.first] = it->second;
+    }
+    
+    zoneTelemetry.assign(numZones, ZoneTelemetry());
+    for (const auto& entry : linkDatarate) {
+        int zone = linkZone(entry.first);
+        if (zone >= 0) zoneTelemetry[zone].links++;
+    }
+    
+    int local = 0;
+    for (auto& flow : flows) {
+        auto src = nodeZone.find(flow.src);
+        flow.zone = src != nodeZone.end() ? src->second : -1;
+        for (const auto& dest : splitDestinations(flow.dst)) {
+            for (const auto& node : getPathTo(flow.src, dest)) {
+                auto it = nodeZone.find(node);
+                if (it == nodeZone.end() || it->second != flow.zone) flow.zone = -1;
+            }
+        }
+        if (flow.zone >= 0) local++;
+    }
+    std::cout << "TDMA SCHEDULER: " << numZones << " zone, " << local << " flussi locali, "
+              << flows.size() - local << " tra zone" << std::endl;
+}
+
+// Link interno a una zona (entrambi gli estremi), -1 = link del backbone
+int TDMAScheduler::linkZone(const std::string& linkId) const {
+    size_t sep = linkId.find("->");
+    auto from = nodeZone.find(linkId.substr(0, sep));
+    auto to = nodeZone.find(linkId.substr(sep + 2));
+    if (from == nodeZone.end() || to == nodeZone.end() || from->second != to->second) return -1;
+    return from->second;
+}
+
 std::vector<std::string> TDMAScheduler::getPathTo(const std::string& src, const std::string& dst) {
     // Controlla cache
     auto cacheKey = std::make_pair(src, dst);
@@ -266,56 +842,208 @@ std::vector<std::string> TDMAScheduler::getPathTo(const std::string& src, const
     return {};
 }
 
-void TDMAScheduler::generateOptimizedSchedule() {
+// Guard per link = 2 * errore massimo dei clock delle sorgenti che lo attraversano
+// (due trasmettitori possono sbagliare in versi opposti). Gli switch inoltrano
+// all'arrivo, quindi l'errore di un frame e' quello del clock della sorgente.
+void TDMAScheduler::computeGuardBands() {
+    if (!adaptiveGuard) return;
+    
+    std::string gm = grandmaster;
+    if (gm.empty()) {
+        for (const auto& adjEntry : adjacency) {
+            if (adjEntry.first.find("switch") != std::string::npos) {
+                gm = adjEntry.first;
+                break;
+            }
+        }
+    }
+    
+    // Errore massimo per nodo, dalla distanza dal grandmaster
+    std::map<std::string, simtime_t> nodeError;
+    for (const auto& adjEntry : adjacency) {
+        cModule *node = findNode(adjEntry.first);
+        cModule *clk = node ? node->getSubmodule("clock") : nullptr;
+        if (!clk) continue;
+        
+        std::vector<std::string> path = getPathTo(gm, adjEntry.first);
+        int hops = path.size() > 1 ? (int)path.size() - 1 : 1;
+        applyParam(clk, "hopsFromGrandmaster", std::to_string(hops));
+        nodeError[adjEntry.first] = TDMAClock::errorBound(clk);
+    }
+    
+    simtime_t fixedGuard = SimTime(guardTime);
+    for (const auto& flow : flows) {
+        simtime_t guard = fixedGuard;
+        auto it = nodeError.find(flow.src);
+        if (it != nodeError.end() && it->second != SIMTIME_MAX) {
+            guard = 2 * it->second;
+        } else {
+            EV_WARN << "Flow " << flow.id << ": clock di " << flow.src
+                    << " non limitato, guard fissa " << fixedGuard << endl;
+        }
+        
+        for (const auto& dest : splitDestinations(flow.dst)) {
+            std::vector<std::string> path = getPathTo(flow.src, dest);
+            for (size_t i = 0; i + 1 < path.size(); i++) {
+                std::string linkId = path[i] + "->" + path[i+1];
+                auto g = linkGuard.find(linkId);
+                if (g == linkGuard.end() || guard > g->second) linkGuard[linkId] = guard;
+            }
+        }
+    }
+    
+    simtime_t minGuard = fixedGuard, maxGuard = 0;
+    for (const auto& entry : linkGuard) {
+        EV << "Guard " << entry.first << ": " << entry.second << endl;
+        minGuard = std::min(minGuard, entry.second);
+        maxGuard = std::max(maxGuard, entry.second);
+    }
+    std::cout << "TDMA SCHEDULER: Guard adattive su " << linkGuard.size() << " link ["
+              << minGuard << ", " << maxGuard << "] (fissa: " << fixedGuard << ")" << std::endl;
+}
+
+simtime_t TDMAScheduler::guardFor(const std::string& linkId) const {
+    auto it = linkGuard.find(linkId);
+    return (it != linkGuard.end()) ? it->second : SimTime(guardTime);
+}
+
+void TDMAScheduler::generateOptimizedSchedule(int mode) {
     std::vector<Job> jobs;
 
     for (auto& flow : flows) {
-        simtime_t txTime = calculateTxTime(flow.payload);
+        if (!(flow.modeMask >> mode & 1)) continue;
+        
+        simtime_t txTime = accessTxTime(flow);
         flow.txTime = txTime;
 
-        int numTransmissions = std::max(1, (int)(hyperperiod / flow.period));
-        if (hyperperiod < flow.period) numTransmissions = 1;
+        int numTransmissions = releasesPerCycle(flow);
 
         // Parsing destinazioni multicast
-        std::vector<std::string> destinations;
-        if (flow.dst.find(',') != std::string::npos) {
-            std::stringstream ss(flow.dst);
-            std::string d;
-            while(std::getline(ss, d, ',')) destinations.push_back(d);
-        } else {
-            destinations.push_back(flow.dst);
-        }
+        std::vector<std::string> destinations = splitDestinations(flow.dst);
+
+        // latencyBound e bounds: massimo sui modi in cui il flusso e' attivo
+        if (flow.shaped) continue;   // Nessuno slot: banda riservata da configureShapers
 
         // Creazione Jobs
         for (int i = 0; i < numTransmissions; i++) {
             simtime_t release = i * flow.period;
-            simtime_t deadline = (i + 1) * flow.period;
+            simtime_t deadline = release + flow.relativeDeadline;
             
             for (int k = 0; k < flow.fragmentCount; k++) {
                 Job job;
                 job.flowId = flow.id;
+                job.flowIdx = flow.index;
                 job.srcNode = flow.src;
                 job.releaseTime = release;
                 job.deadline = deadline;
                 job.txDuration = txTime;
+                // Coda del messaggio dimensionata esattamente (anche per evento se sporadico)
+                bool tail = (k % flow.messageFragments) == flow.messageFragments - 1;
+                job.payload = tail ? flow.lastPayload : flow.payload;
                 job.fragmentIndex = k;
+                job.priority = flow.priority;
+                job.zone = flow.zone;
                 job.destinations = destinations;
                 jobs.push_back(job);
             }
         }
     }
+    
+    if (zonalScheduling) scheduleZones(jobs, mode);
+    else placeJobs(jobs, mode);
+}
 
-    // Ordinamento EDF
+// Scheduling a due livelli. I job tra zone sono piazzati per primi sulla tabella completa:
+// le loro prenotazioni sui link di una zona sono il budget della zona, che piazza i propri
+// job su una tabella con i soli link di zona. Le zone non condividono link, quindi l'unione
+// delle tabelle e degli slot e' lo schedule del modo (verificato da validateModes)
+void TDMAScheduler::scheduleZones(std::vector<Job>& jobs, int mode) {
+    std::vector<Job> backbone;
+    std::vector<std::vector<Job>> local(numZones);
+    for (auto& job : jobs) {
+        if (job.zone < 0) backbone.push_back(std::move(job));
+        else local[job.zone].push_back(std::move(job));
+    }
+    jobs.clear();
+    
+    placeJobs(backbone, mode);
+    endPhase("scheduleBackbone");
+    
+    // Finestre del backbone sui link di zona -> tabella della zona. Budget = quota libera
+    // del link di zona piu' carico
+    std::vector<std::map<std::string, std::vector<LinkReservation>>> zoneTables(numZones);
+    for (auto it = linkTable.begin(); it != linkTable.end();) {
+        int zone = linkZone(it->first);
+        if (zone < 0) {
+            ++it;
+            continue;
+        }
+        simtime_t reserved;
+        for (const auto& res : it->second) reserved += res.end - res.start;
+        zoneTelemetry[zone].budget = std::min(zoneTelemetry[zone].budget, 1 - reserved / hyperperiod);
+        zoneTables[zone][it->first].swap(it->second);
+        it = linkTable.erase(it);
+    }
+    
+    // Secondo livello: ogni zona lavora solo su tabella e slot propri
+    std::vector<std::vector<Slot>> zoneSlots(numZones);
+    for (int z = 0; z < numZones; z++) {
+        if (local[z].empty()) continue;
+        auto start = std::chrono::steady_clock::now();
+        linkTable.swap(zoneTables[z]);
+        schedule.swap(zoneSlots[z]);
+        placeJobs(local[z], mode);
+        schedule.swap(zoneSlots[z]);
+        linkTable.swap(zoneTables[z]);
+        zoneTelemetry[z].jobs += local[z].size();
+        zoneTelemetry[z].seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    endPhase("scheduleZones");
+    
+    // Stitching: link disgiunti, le tabelle di zona entrano intere in quella del modo
+    for (int z = 0; z < numZones; z++) {
+        for (auto& entry : zoneTables[z]) linkTable[entry.first].swap(entry.second);
+        schedule.insert(schedule.end(), zoneSlots[z].begin(), zoneSlots[z].end());
+    }
+    endPhase("stitchZones");
+}
+
+// Piazzamento di un insieme di job sulla linkTable e sullo schedule correnti
+void TDMAScheduler::placeJobs(std::vector<Job>& jobs, int mode) {
+    // Criticita' prima, EDF a parita' di classe: i flussi Safety occupano per primi le finestre
+    // piu' vicine al rilascio. I frammenti di un'istanza restano contigui (rollback del rifiuto)
     std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) {
+        if (a.priority != b.priority) return a.priority < b.priority;
         if (a.deadline != b.deadline) return a.deadline < b.deadline;
-        return a.releaseTime < b.releaseTime;
+        if (a.releaseTime != b.releaseTime) return a.releaseTime < b.releaseTime;
+        if (a.flowIdx != b.flowIdx) return a.flowIdx < b.flowIdx;
+        return a.fragmentIndex < b.fragmentIndex;
     });
 
     int totalJobs = jobs.size();
+    if (totalJobs == 0) return;
     EV << "Jobs totali da schedulare: " << totalJobs << endl;
     std::cout << "Jobs da schedulare: " << totalJobs << std::endl;
     int processed = 0;
     int lastPercent = -1;
+    
+    // Istanza (flusso, rilascio) -> inizio primo frammento, ultimo arrivo e latenze per
+    // destinazione. Riportate sul flusso solo a fine piazzamento: un'istanza rifiutata non conta
+    struct BurstSpan {
+        simtime_t firstStart = SIMTIME_MAX;
+        simtime_t latencyBound;
+        simtime_t minSlack = SIMTIME_MAX;
+        std::vector<simtime_t> lastArrival;
+        std::vector<simtime_t> maxLatency;
+        std::vector<simtime_t> minLatency;
+    };
+    std::map<std::pair<int, int64_t>, BurstSpan> bursts;
+    
+    // Istanza in corso: slot e prenotazioni da annullare se un suo frammento e' rifiutato
+    std::set<std::pair<int, int64_t>>& rejected = modes[mode].rejected;
+    std::pair<int, int64_t> instance(-1, 0);
+    size_t instanceSlots = 0;
+    std::vector<std::pair<std::string, simtime_t>> instanceLinks;   // (link, inizio prenotazione)
 
     // Scheduling
     for (const auto& job : jobs) {
@@ -326,77 +1054,381 @@ void TDMAScheduler::generateOptimizedSchedule() {
             lastPercent = percent;
         }
 
-        simtime_t t = job.releaseTime;
-        bool scheduled = false;
+        std::pair<int, int64_t> key(job.flowIdx, job.releaseTime.raw());
+        if (key != instance) {
+            instance = key;
+            instanceSlots = schedule.size();
+            instanceLinks.clear();
+        }
+        if (rejected.count(key)) continue;   // Frammento di un'istanza gia' rifiutata
         
-        while (!scheduled) {
-            if (t > hyperperiod * 1.5) {
-                EV_ERROR << "Impossibile schedulare job " << job.flowId << endl;
-                break;
+        // Percorso del job: inizio e durata su ogni link relativi alla partenza t, invariati
+        // tra i tentativi. Link -> (offset inizio, durata TX sul link)
+        std::map<std::string, std::pair<simtime_t, simtime_t>> linkOffsets;
+        std::vector<simtime_t> destOffset(job.destinations.size(), SIMTIME_ZERO);
+        simtime_t lastOffset;   // Arrivo all'ultima destinazione
+        simtime_t lastEnd;      // Fine dell'ultima prenotazione, guard compresa
+        for (size_t d = 0; d < job.destinations.size(); d++) {
+            const std::string& dest = job.destinations[d];
+            std::vector<std::string> path = getPathTo(job.srcNode, dest);
+            if (path.empty()) {
+                EV_ERROR << "Path non trovato: " << job.srcNode << " -> " << dest << endl;
+                continue; 
             }
-
-            bool pathFree = true;
-            std::map<std::string, simtime_t> linkArrivals;
-
-            // Calcolo tempi arrivo sui link per tutte le destinazioni
-            for (const auto& dest : job.destinations) {
-                std::vector<std::string> path = getPathTo(job.srcNode, dest);
-                if (path.empty()) {
-                    EV_ERROR << "Path non trovato: " << job.srcNode << " -> " << dest << endl;
-                    continue; 
-                }
+            
+            simtime_t hopTime;
+            for (size_t i = 0; i < path.size() - 1; i++) {
+                std::string linkId = path[i] + "->" + path[i+1];
                 
-                simtime_t hopTime = t;
-                for (size_t i = 0; i < path.size() - 1; i++) {
-                    std::string u = path[i];
-                    std::string v = path[i+1];
-                    std::string linkId = u + "->" + v;
-                    
-                    if (i > 0) hopTime += switchDelay;
-                    
-                    if (linkArrivals.find(linkId) == linkArrivals.end()) 
-                        linkArrivals[linkId] = hopTime;
-                    
-                    hopTime += job.txDuration + propagationDelay;
+                if (i > 0) hopTime += switchDelay;
+                
+                simtime_t linkTx = txTimeOn(linkId, job.payload);
+                if (linkOffsets.find(linkId) == linkOffsets.end()) {
+                    linkOffsets[linkId] = {hopTime, linkTx};
+                    lastEnd = std::max(lastEnd, hopTime + linkTx + guardFor(linkId));
                 }
+                
+                hopTime += linkTx + propagationDelay;
             }
+            destOffset[d] = hopTime;
+            if (hopTime > lastOffset) lastOffset = hopTime;
+        }
+        
+        simtime_t t = job.releaseTime;
+        bool scheduled = false;
+        long attempts = 0;
+        
+        while (!scheduled) {
+            if (t > hyperperiod * 1.5) break;
+            // Con piu' modi nessuna prenotazione oltre l'hyperperiod: la coda del modo
+            // uscente occuperebbe l'inizio del primo ciclo del modo entrante
+            if (modes.size() > 1 && t + lastEnd > hyperperiod) break;
+            attempts++;
+
+            // Ogni istante successivo arriva piu' tardi: oltre la deadline il job e' rifiutato
+            simtime_t lastArrival = t + lastOffset;
+            if (lastArrival > job.deadline) break;
 
-            // Verifica collisioni
-            for (const auto& entry : linkArrivals) {
-                if (!isLinkFree(entry.first, entry.second, job.txDuration, guardTime)) {
+            // Verifica collisioni: al primo link occupato si riparte dalla fine della
+            // prenotazione che lo blocca, gli istanti intermedi lo trovano comunque occupato
+            bool pathFree = true;
+            for (const auto& entry : linkOffsets) {
+                simtime_t start = t + entry.second.first;
+                simtime_t freeAt;
+                if (!isLinkFree(entry.first, start, entry.second.second, guardFor(entry.first), freeAt)) {
+                    t += freeAt - start;
                     pathFree = false;
                     break;
                 }
             }
-
-            if (pathFree) {
-                scheduled = true;
-                schedule.push_back({job.flowId, job.srcNode, t, job.txDuration, SLOT_SENDER});
-                
-                for (const auto& entry : linkArrivals) {
-                    reserveLink(entry.first, entry.second, job.txDuration, guardTime);
-                    std::string senderNode = entry.first.substr(0, entry.first.find("->"));
-                    if (senderNode.find("switch") != std::string::npos) {
-                        schedule.push_back({job.flowId, senderNode, entry.second, job.txDuration, SLOT_SWITCH});
-                    }
+            if (!pathFree) continue;
+            
+            scheduled = true;
+            
+            // Latenza pianificata slot -> destinazione (pubblicata ai sender) e limiti analitici
+            // per ramo: latenza del frammento e span del burst, accumulati sull'istanza
+            BurstSpan& span = bursts[key];
+            if (t < span.firstStart) span.firstStart = t;
+            if (lastOffset > span.latencyBound) span.latencyBound = lastOffset;
+            if (job.deadline - lastArrival < span.minSlack) span.minSlack = job.deadline - lastArrival;
+            span.lastArrival.resize(job.destinations.size());
+            span.maxLatency.resize(job.destinations.size());
+            span.minLatency.resize(job.destinations.size(), SIMTIME_MAX);
+            for (size_t d = 0; d < job.destinations.size(); d++) {
+                simtime_t latency = destOffset[d];
+                if (latency > span.maxLatency[d]) span.maxLatency[d] = latency;
+                if (latency < span.minLatency[d]) span.minLatency[d] = latency;
+                if (t + latency > span.lastArrival[d]) span.lastArrival[d] = t + latency;
+            }
+            
+            for (const auto& entry : linkOffsets) {
+                simtime_t start = t + entry.second.first;
+                reserveLink(entry.first, start, entry.second.second, guardFor(entry.first));
+                instanceLinks.push_back({entry.first, start});
+                std::string senderNode = entry.first.substr(0, entry.first.find("->"));
+                if (senderNode == job.srcNode) {
+                    schedule.push_back({job.flowId, senderNode, entry.first, start, entry.second.second,
+                                        SLOT_SENDER, job.releaseTime, job.deadline});
+                } else if (senderNode.find("switch") != std::string::npos) {
+                    schedule.push_back({job.flowId, senderNode, entry.first, start, entry.second.second,
+                                        SLOT_SWITCH, job.releaseTime, job.deadline});
                 }
-            } else {
-                t += 1e-6; // Retry
             }
         }
+        
+        jobsTotal++;
+        placementAttempts += attempts;
+        maxAttemptsPerJob = std::max(maxAttemptsPerJob, attempts);
+        if (!scheduled) {
+            rejectJob(job, mode);
+            failedJobs++;
+            rejected.insert(key);
+            
+            // Frammenti gia' piazzati: i loro slot sono gli ultimi dello schedule
+            schedule.resize(instanceSlots);
+            for (const auto& entry : instanceLinks) releaseLink(entry.first, entry.second);
+            instanceLinks.clear();
+            bursts.erase(key);
+        }
     }
+    
+    // Solo le istanze piazzate per intero (le rifiutate sono state tolte da bursts)
+    for (const auto& entry : bursts) {
+        Flow& flow = flows[entry.first.first];
+        const BurstSpan& span = entry.second;
+        if (span.latencyBound > flow.latencyBound) flow.latencyBound = span.latencyBound;
+        if (span.minSlack < flow.minSlack) flow.minSlack = span.minSlack;
+        std::vector<std::string> destinations = splitDestinations(flow.dst);
+        for (size_t d = 0; d < span.lastArrival.size(); d++) {
+            DestinationBound& bound = flow.bounds[destinations[d]];
+            if (span.maxLatency[d] > bound.maxLatency) bound.maxLatency = span.maxLatency[d];
+            if (span.minLatency[d] < bound.minLatency) bound.minLatency = span.minLatency[d];
+            simtime_t burstLatency = span.lastArrival[d] - span.firstStart;
+            if (flow.isFragmented && burstLatency > bound.maxBurstLatency) bound.maxBurstLatency = burstLatency;
+        }
+    }
+}
+
+// Rifiuto esplicito: nessuno slot per l'istanza, il sender salta il job. Per le classi
+// critiche (priority <= criticalPriority) lo schedule non e' accettabile
+void TDMAScheduler::rejectJob(const Job& job, int mode) {
+    Flow& flow = flows[job.flowIdx];
+    flow.unscheduledJobs++;
+    if (job.priority <= criticalPriority) {
+        throw cRuntimeError("Job critico %s (classe %d, rilascio %s) non piazzabile entro la deadline %s o l'hyperperiod (modo '%s')",
+                            job.flowId.c_str(), job.priority, job.releaseTime.str().c_str(), job.deadline.str().c_str(),
+                            modes[mode].name.c_str());
+    }
+    EV_WARN << "Job " << job.flowId << " (classe " << job.priority << ", rilascio " << job.releaseTime
+            << ") rifiutato: nessuna finestra entro la deadline " << job.deadline
+            << (modes.size() > 1 ? " e l'hyperperiod" : "") << endl;
+}
+
+// Richieste "istante:modo,..." di modeRequests, note prima della simulazione: il modo
+// entra in vigore al confine di hyperperiod successivo alla richiesta
+void TDMAScheduler::resolveModeRequests() {
+    std::string spec = par("modeRequests").stringValue();
+    if (spec.empty()) return;
+    
+    for (const auto& request : splitDestinations(spec)) {
+        size_t sep = request.find(':');
+        if (sep == std::string::npos) {
+            throw cRuntimeError("modeRequests: '%s' non nel formato istante:modo", request.c_str());
+        }
+        simtime_t at = SimTime::parse(request.substr(0, sep).c_str());
+        long cycle = (long)floor(at / hyperperiod) + 1;
+        if (cycle <= lastModeCycle) {
+            throw cRuntimeError("modeRequests: '%s' non successiva all'hyperperiod della richiesta precedente",
+                                request.c_str());
+        }
+        addModeSwitch(request.substr(sep + 1), at, cycle);
+    }
+}
+
+// Richiesta a runtime (parametro modeRequest): cambio al prossimo confine, distribuito
+// ai moduli con applyParam. Una seconda richiesta nello stesso hyperperiod, o dopo
+// l'estrapolazione del fast-forward, e' rifiutata
+void TDMAScheduler::handleParameterChange(const char *name) {
+    if (strcmp(name, "modeRequest") != 0) return;
+    std::string mode = par("modeRequest").stringValue();
+    if (mode.empty()) return;
+    if (!par("enabled").boolValue()) {
+        throw cRuntimeError("modeRequest a runtime richiede lo scheduler abilitato");
+    }
+    
+    long cycle = (long)floor(simTime() / hyperperiod) + 1;
+    if (cycle <= lastModeCycle || steadyStateAt >= 0) {
+        modeRequestsRejected++;
+        EV_WARN << "Richiesta del modo " << mode << " a " << simTime() << " rifiutata: "
+                << (steadyStateAt >= 0 ? "regime gia' estrapolato" : "cambio gia' richiesto per il ciclo") << endl;
+        return;
+    }
+    addModeSwitch(mode, simTime(), cycle);
+    for (cModule *target : modeTargets) {
+        applyParam(target, "modeSwitches", iniString(modeSwitchConfig));
+    }
+}
+
+// Accoda (ciclo, modo, istante della richiesta) alla lista distribuita: la latenza di
+// transizione e' misurata dai moduli quando applicano la nuova tabella
+void TDMAScheduler::addModeSwitch(const std::string& name, simtime_t at, long cycle) {
+    if (modes.size() < 2) {
+        throw cRuntimeError("Richiesta di cambio modo con meno di due modi in modes");
+    }
+    size_t m = 0;
+    while (m < modes.size() && modes[m].name != name) m++;
+    if (m == modes.size()) {
+        throw cRuntimeError("Richiesta di cambio modo: modo '%s' non definito", name.c_str());
+    }
+    
+    lastModeCycle = cycle;
+    lastModeActivation = hyperperiod * cycle;
+    modeRequestsAccepted++;
+    if (!modeSwitchConfig.empty()) modeSwitchConfig += ",";
+    modeSwitchConfig += std::to_string(cycle) + ":" + std::to_string(m) + ":" + at.str();
+    std::cout << "TDMA SCHEDULER: modo " << name << " richiesto a " << at
+              << ", attivo da " << lastModeActivation << std::endl;
+}
+
+// Durata di un frammento sul link di accesso della sorgente
+simtime_t TDMAScheduler::accessTxTime(const Flow& flow) {
+    if (adjacency[flow.src].empty()) return calculateTxTime(flow.payload, datarate);
+    return txTimeOn(flow.src + "->" + adjacency[flow.src][0].first, flow.payload);
+}
+
+// MTU minima sui link verso tutte le destinazioni: il jumbo frame serve solo se ogni
+// link del percorso lo supporta
+int TDMAScheduler::pathMtu(const Flow& flow) {
+    int mtu = tdma::JUMBO_MTU_BYTES;
+    for (const auto& dest : splitDestinations(flow.dst)) {
+        std::vector<std::string> path = getPathTo(flow.src, dest);
+        for (size_t i = 0; i + 1 < path.size(); i++) {
+            auto it = linkMtu.find(path[i] + "->" + path[i + 1]);
+            mtu = std::min(mtu, it != linkMtu.end() ? it->second : tdma::MTU_BYTES);
+        }
+    }
+    return mtu;
+}
+
+// Frammenti da messageSize: payload pieni alla MTU del percorso e ultimo frammento col resto.
+// Sostituisce payloadSize e burstSize del sender (scritti da configureSenders)
+void TDMAScheduler::fragmentMessage(Flow& flow) {
+    int mtu = pathMtu(flow);
+    if (mtu <= 0) {
+        throw cRuntimeError("Flow %s: MTU non valida (%d) sul percorso", flow.id.c_str(), mtu);
+    }
+    flow.messageFragments = (flow.messageSize + mtu - 1) / mtu;
+    flow.payload = std::min(flow.messageSize, mtu);
+    flow.lastPayload = flow.messageSize - (flow.messageFragments - 1) * flow.payload;
+    flow.fragmentCount = flow.messageFragments * flow.serverBudget;
+    flow.isFragmented = flow.fragmentCount > 1;
+    EV << "Flow " << flow.id << ": messaggio " << flow.messageSize << "B -> " << flow.messageFragments
+       << " x " << flow.payload << "B (ultimo " << flow.lastPayload << "B, MTU " << mtu << ")" << endl;
+}
+
+int TDMAScheduler::releasesPerCycle(const Flow& flow) const {
+    if (hyperperiod < flow.period) return 1;
+    return std::max(1, (int)(hyperperiod / flow.period));
+}
+
+// Verifica di ogni modo con un validatore che non condivide la contabilita' dello
+// scheduler: i job attesi sono ricostruiti da flussi e percorsi, gli slot dalla tabella
+void TDMAScheduler::validateModes() {
+    ScheduleValidator validator(hyperperiod, propagationDelay,
+                                [this](const std::string& linkId) { return guardFor(linkId); });
+    int total = 0;
+    
+    for (size_t m = 0; m < modes.size(); m++) {
+        const ModeTable& mode = modes[m];
+        std::vector<ScheduleValidator::ExpectedJob> expected;
+        for (const auto& flow : flows) {
+            if (!(flow.modeMask >> m & 1) || flow.shaped) continue;
+            
+            std::set<std::string> links;
+            for (const auto& dest : splitDestinations(flow.dst)) {
+                std::vector<std::string> path = getPathTo(flow.src, dest);
+                for (size_t i = 0; i + 1 < path.size(); i++) links.insert(path[i] + "->" + path[i + 1]);
+            }
+            for (int i = 0; i < releasesPerCycle(flow); i++) {
+                if (mode.rejected.count({flow.index, (flow.period * i).raw()})) continue;
+                expected.push_back({flow.id, flow.period * i, flow.fragmentCount,
+                                    std::vector<std::string>(links.begin(), links.end())});
+            }
+        }
+        
+        int found = validator.validate(mode.schedule, expected);
+        total += found;
+        for (int i = 0; i < ScheduleValidator::NUM_ISSUE_TYPES; i++) {
+            validationIssues[i] += validator.count((ScheduleValidator::IssueType)i);
+        }
+        for (const auto& issue : validator.getIssues()) {
+            EV_ERROR << "Schedule" << (mode.name.empty() ? "" : " " + mode.name) << ": "
+                     << validator.describe(issue, mode.schedule) << endl;
+        }
+        std::cout << "TDMA SCHEDULER: validazione" << (mode.name.empty() ? "" : " " + mode.name) << " - "
+                  << mode.schedule.size() << " slot, " << found << " problemi (overlap "
+                  << validator.count(ScheduleValidator::ISSUE_OVERLAP) << ", guard "
+                  << validator.count(ScheduleValidator::ISSUE_GUARD) << ", deadline "
+                  << validator.count(ScheduleValidator::ISSUE_DEADLINE) << ", incompleti "
+                  << validator.count(ScheduleValidator::ISSUE_INCOMPLETE) << ")" << std::endl;
+    }
+    
+    if (total > 0 && par("failOnInvalidSchedule").boolValue()) {
+        throw cRuntimeError("Schedule non valido: %d problemi (dettaglio nel log)", total);
+    }
+}
+
+// CSV "mode,flowId,node,link,type,offset,duration,release,deadline" con SimTime esatti
+void TDMAScheduler::exportSchedule(const std::string& file) const {
+    std::ofstream out(file);
+    if (!out) {
+        throw cRuntimeError("Impossibile scrivere scheduleExportFile '%s'", file.c_str());
+    }
+    out << "mode,flowId,node,link,type,offset,duration,release,deadline\n";
+    for (const auto& mode : modes) {
+        for (const auto& slot : mode.schedule) {
+            out << mode.name << "," << slot.flowId << "," << slot.node << "," << slot.link << ","
+                << (slot.type == SLOT_SENDER ? "sender" : "switch") << "," << slot.offset.str() << ","
+                << slot.duration.str() << "," << slot.release.str() << "," << slot.deadline.str() << "\n";
+        }
+    }
+    std::cout << "TDMA SCHEDULER: schedule esportato in " << file << std::endl;
+}
+
+// Slot da un CSV di exportSchedule; le prenotazioni dei link sono ricostruite dagli slot.
+// I limiti analitici dipendono dal piazzamento e restano non disponibili
+void TDMAScheduler::importSchedule(const std::string& file) {
+    std::ifstream in(file);
+    if (!in) {
+        throw cRuntimeError("Impossibile leggere scheduleImportFile '%s'", file.c_str());
+    }
+    
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        if (line.empty() || line.compare(0, 5, "mode,") == 0) continue;
+        
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ',')) fields.push_back(field);
+        if (fields.size() != 9) {
+            throw cRuntimeError("%s:%d: attesi 9 campi, trovati %d", file.c_str(), lineNumber, (int)fields.size());
+        }
+        
+        size_t m = 0;
+        while (m < modes.size() && modes[m].name != fields[0]) m++;
+        if (m == modes.size()) {
+            throw cRuntimeError("%s:%d: modo '%s' non definito", file.c_str(), lineNumber, fields[0].c_str());
+        }
+        
+        Slot slot = {fields[1], fields[2], fields[3], SimTime::parse(fields[5].c_str()),
+                     SimTime::parse(fields[6].c_str()), fields[4] == "sender" ? SLOT_SENDER : SLOT_SWITCH,
+                     SimTime::parse(fields[7].c_str()), SimTime::parse(fields[8].c_str())};
+        modes[m].schedule.push_back(slot);
+        modes[m].linkTable[slot.link].push_back({slot.offset, slot.offset + slot.duration + guardFor(slot.link)});
+    }
+    
+    for (auto& flow : flows) {
+        flow.txTime = accessTxTime(flow);
+    }
+    std::cout << "TDMA SCHEDULER: schedule importato da " << file << std::endl;
 }
 
-simtime_t TDMAScheduler::calculateTxTime(int payloadBytes) {
+simtime_t TDMAScheduler::calculateTxTime(int payloadBytes, double linkRate) const {
     int totalBytes = payloadBytes + tdma::ETHERNET_OVERHEAD;
-    return SimTime((double)(totalBytes * 8) / datarate, SIMTIME_S);
+    return SimTime((double)(totalBytes * 8) / linkRate, SIMTIME_S);
 }
 
-void TDMAScheduler::configureSenders() {
-    cModule *network = getParentModule();
+simtime_t TDMAScheduler::txTimeOn(const std::string& linkId, int payloadBytes) const {
+    auto it = linkDatarate.find(linkId);
+    return calculateTxTime(payloadBytes, it != linkDatarate.end() ? it->second : datarate);
+}
 
+void TDMAScheduler::configureSenders() {
     for (const auto& flow : flows) {
-        cModule* node = network->getSubmodule(flow.src.c_str());
+        cModule* node = findNode(flow.src);
         if (!node) continue;
 
         for (cModule::SubmoduleIterator appIt(node); !appIt.end(); ++appIt) {
@@ -404,27 +1436,249 @@ void TDMAScheduler::configureSenders() {
             if (std::string(app->getName()) == "senderApp" && 
                 std::string(app->par("flowId").stringValue()) == flow.id) {
                 
-                std::stringstream offsets;
-                bool first = true;
-                std::vector<simtime_t> flowSlots;
-                
-                for (const auto& slot : schedule) {
-                    if (slot.flowId == flow.id && slot.node == flow.src && slot.type == SLOT_SENDER) {
-                        flowSlots.push_back(slot.offset);
+                // Una tabella per modo. SimTime in forma esatta: la precisione di default
+                // di double (6 cifre) sposterebbe gli slot di centinaia di ns
+                std::vector<std::string> offsets(modes.size()), releases(modes.size());
+                for (size_t m = 0; m < modes.size(); m++) {
+                    std::vector<std::pair<simtime_t, simtime_t>> flowSlots;  // (offset, rilascio)
+                    if (flow.shaped) {
+                        // Tutti i frammenti al rilascio: li distanzia lo shaper
+                        for (int i = 0; (flow.modeMask >> m & 1) && i < releasesPerCycle(flow); i++) {
+                            flowSlots.insert(flowSlots.end(), flow.fragmentCount, {flow.period * i, flow.period * i});
+                        }
+                    }
+                    for (const auto& slot : modes[m].schedule) {
+                        if (slot.flowId == flow.id && slot.node == flow.src && slot.type == SLOT_SENDER) {
+                            flowSlots.push_back({slot.offset, slot.release});
+                        }
+                    }
+                    std::sort(flowSlots.begin(), flowSlots.end());
+                    
+                    for (size_t i = 0; i < flowSlots.size(); i++) {
+                        if (i > 0) {
+                            offsets[m] += ",";
+                            releases[m] += ",";
+                        }
+                        offsets[m] += flowSlots[i].first.str();
+                        releases[m] += flowSlots[i].second.str();
                     }
                 }
-                std::sort(flowSlots.begin(), flowSlots.end());
                 
-                for (const auto& t : flowSlots) {
-                    if (!first) offsets << ",";
-                    offsets << t.dbl();
-                    first = false;
+                if (tdma::isMulticast(tdma::parseMac(flow.dstMac))) {
+                    applyParam(app, "dstAddr", iniString(flow.dstMac));
+                }
+                applyParam(app, "tdmaSlots", iniString(offsets[0]));
+                applyParam(app, "tdmaReleases", iniString(releases[0]));
+                if (modes.size() > 1) {
+                    std::string table;
+                    for (size_t m = 0; m < modes.size(); m++) {
+                        if (m > 0) table += "|";
+                        table += offsets[m] + "/" + releases[m];
+                    }
+                    applyParam(app, "modeSlots", iniString(table));
+                    applyParam(app, "modeSwitches", iniString(modeSwitchConfig));
+                    modeTargets.push_back(app);
+                }
+                applyParam(app, "latencyBound", iniSeconds(flow.latencyBound));
+                // Sporadico: deadline implicita dell'evento pari al minimo interarrivo
+                applyParam(app, "relativeDeadline", iniSeconds(flow.sporadic ? flow.minInterArrival : flow.relativeDeadline));
+                if (flow.sporadic) applyParam(app, "responseBound", iniSeconds(flow.responseBound));
+                applyParam(app, "txDuration", iniSeconds(flow.txTime));
+                if (flow.messageSize > 0) {
+                    applyParam(app, "payloadSize", std::to_string(flow.payload) + "B");
+                    applyParam(app, "burstSize", std::to_string(flow.messageFragments));
+                    applyParam(app, "lastFragmentSize", std::to_string(flow.lastPayload) + "B");
+                }
+                applyParam(app, "hyperperiod", iniSeconds(hyperperiod));
+                applyParam(app, "flowIndex", std::to_string(flow.index));
+            }
+        }
+    }
+}
+
+// Limite network calculus dei flussi se trasmessi senza schedule: ogni porta e' una coda
+// FIFO aggregata con servizio rate-latency (T = switchDelay + propagazione). Il burst di un
+// flusso (frammenti back-to-back) cresce lungo il percorso di r * ritardo a monte; i ritardi
+// per link si ottengono per iterazione di punto fisso
+void TDMAScheduler::computeNetworkCalculusBounds() {
+    std::vector<std::vector<std::vector<std::string>>> flowLinks(flows.size());
+    std::map<std::string, double> linkDelay;
+    std::map<std::string, double> linkLoad;
+    
+    for (size_t f = 0; f < flows.size(); f++) {
+        const Flow& flow = flows[f];
+        std::set<std::string> seen;
+        for (const auto& dest : splitDestinations(flow.dst)) {
+            std::vector<std::string> path = getPathTo(flow.src, dest);
+            std::vector<std::string> links;
+            for (size_t i = 0; i + 1 < path.size(); i++) {
+                std::string linkId = path[i] + "->" + path[i + 1];
+                links.push_back(linkId);
+                linkDelay[linkId] = 0;
+                if (seen.insert(linkId).second) {
+                    linkLoad[linkId] += flow.fragmentCount * txTimeOn(linkId, flow.payload).dbl() / flow.period.dbl();
                 }
-                
-                app->par("tdmaSlots").setStringValue(offsets.str());
-                app->par("txDuration").setDoubleValue(flow.txTime.dbl());
-                app->par("hyperperiod").setDoubleValue(hyperperiod.dbl());
             }
+            flowLinks[f].push_back(links);
+        }
+    }
+    
+    bool stable = true;
+    for (const auto& load : linkLoad) {
+        if (load.second >= 1.0) {
+            EV_WARN << "Network calculus: link " << load.first << " saturo (carico " << load.second << ")" << endl;
+            stable = false;
+        }
+    }
+    
+    // Punto fisso: ritardi monotoni crescenti, oltre l'hyperperiod il limite e' inutile
+    for (int iter = 0; stable && iter < 100; iter++) {
+        std::map<std::string, double> next;
+        for (const auto& entry : linkDelay) {
+            std::string u = entry.first.substr(0, entry.first.find("->"));
+            next[entry.first] = propagationDelay + (u.find("switch") != std::string::npos ? switchDelay : 0);
+        }
+        for (size_t f = 0; f < flows.size(); f++) {
+            const Flow& flow = flows[f];
+            std::set<std::string> seen;
+            for (const auto& links : flowLinks[f]) {
+                double upstream = 0;
+                for (const auto& linkId : links) {
+                    if (seen.insert(linkId).second) {
+                        next[linkId] += flow.fragmentCount * txTimeOn(linkId, flow.payload).dbl()
+                                        * (1 + upstream / flow.period.dbl());
+                    }
+                    upstream += linkDelay[linkId];
+                }
+            }
+        }
+        
+        double change = 0, maxDelay = 0;
+        for (const auto& entry : next) {
+            change = std::max(change, entry.second - linkDelay[entry.first]);
+            maxDelay = std::max(maxDelay, entry.second);
+        }
+        linkDelay.swap(next);
+        if (maxDelay > hyperperiod.dbl()) stable = false;
+        if (change < 1e-12) break;
+    }
+    
+    for (size_t f = 0; f < flows.size(); f++) {
+        double bound = 0;
+        for (const auto& links : flowLinks[f]) {
+            double sum = 0;
+            for (const auto& linkId : links) sum += linkDelay[linkId];
+            bound = std::max(bound, sum);
+        }
+        flows[f].ncBound = stable ? SimTime(bound) : SIMTIME_MAX;
+    }
+}
+
+// Risposta massima di un evento sporadico. Caso peggiore: evento appena dopo l'inizio del
+// job j del server, seguito da eventi al minimo interarrivo m; l'evento q e' servito dal job
+// j + 1 + q/budget se arriva prima del suo inizio, altrimenti la coda si e' svuotata. Con
+// n job per hyperperiod e n*budget*m >= H la risposta non cresce da un giro di n*budget
+// eventi al successivo: basta il primo. Si aggiunge la latenza massima di un job fino
+// alle destinazioni. Transizioni tra modi non considerate
+void TDMAScheduler::computeResponseBounds() {
+    for (auto& flow : flows) {
+        if (!flow.sporadic) continue;
+        flow.responseBound = -1;
+        if (flow.bounds.empty() || flow.unscheduledJobs > 0) continue;   // Importato o incompleto
+        
+        simtime_t jobLatency;
+        for (const auto& entry : flow.bounds) {
+            jobLatency = std::max(jobLatency, std::max(entry.second.maxLatency, entry.second.maxBurstLatency));
+        }
+        
+        simtime_t wait;
+        bool bounded = true;
+        for (size_t m = 0; m < modes.size() && bounded; m++) {
+            if (!(flow.modeMask >> m & 1)) continue;
+            
+            std::map<int64_t, simtime_t> jobStart;   // Rilascio -> primo slot del job
+            for (const auto& slot : modes[m].schedule) {
+                if (slot.flowId != flow.id || slot.type != SLOT_SENDER) continue;
+                auto it = jobStart.find(slot.release.raw());
+                if (it == jobStart.end() || slot.offset < it->second) jobStart[slot.release.raw()] = slot.offset;
+            }
+            std::vector<simtime_t> starts;
+            for (const auto& entry : jobStart) starts.push_back(entry.second);
+            std::sort(starts.begin(), starts.end());
+            
+            long n = starts.size();
+            long perCycle = n * flow.serverBudget;
+            if (n == 0 || flow.minInterArrival * perCycle < hyperperiod) {
+                bounded = false;
+                break;
+            }
+            auto start = [&](long k) { return starts[k % n] + hyperperiod * (k / n); };
+            
+            for (long j = 0; j < n; j++) {
+                for (long q = 0; q < perCycle; q++) {
+                    simtime_t arrival = starts[j] + flow.minInterArrival * q;
+                    simtime_t service = start(j + 1 + q / flow.serverBudget);
+                    if (q > 0 && arrival >= service) break;
+                    if (service - arrival > wait) wait = service - arrival;
+                }
+            }
+        }
+        
+        if (bounded) flow.responseBound = wait + jobLatency;
+        std::cout << "TDMA SCHEDULER: sporadico " << flow.id << " - server " << flow.period
+                  << " x " << flow.serverBudget << " eventi, risposta max "
+                  << (bounded ? flow.responseBound.str() : std::string("non limitata")) << std::endl;
+        if (bounded && flow.responseBound > flow.minInterArrival) {
+            EV_WARN << "Flow " << flow.id << ": risposta max " << flow.responseBound
+                    << " oltre il minimo interarrivo " << flow.minInterArrival << endl;
+        }
+    }
+}
+
+// Limiti analitici per ramo alle receiverApp di destinazione ("flowId:wcl:jitter:burst:nc",
+// -1 = non limitato), registrati accanto alle misure
+void TDMAScheduler::configureReceivers() {
+    auto fmt = [](simtime_t t, bool valid) { return valid ? t.str() : std::string("-1"); };
+    
+    // Nodo destinazione -> (flusso, limiti "flowId:wcl:jitter:burst:nc")
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>> perNode;
+    for (const auto& flow : flows) {
+        for (const auto& dest : splitDestinations(flow.dst)) {
+            auto it = flow.bounds.find(dest);
+            bool valid = it != flow.bounds.end() && flow.unscheduledJobs == 0;
+            DestinationBound bound = valid ? it->second : DestinationBound();
+            if (flow.sporadic) {
+                // Evento -> arrivo, attesa del job del server compresa
+                valid = valid && flow.responseBound >= 0;
+                bound.maxLatency = bound.maxBurstLatency = flow.responseBound;
+            }
+            
+            perNode[dest].push_back({flow.id, flow.id + ":" + fmt(bound.maxLatency, valid)
+                   + ":" + fmt(bound.maxLatency - bound.minLatency, valid)
+                   + ":" + (flow.isFragmented ? fmt(bound.maxBurstLatency, valid) : std::string("0"))
+                   + ":" + fmt(flow.ncBound, flow.ncBound != SIMTIME_MAX)});
+            
+            EV << "Analitico " << flow.id << " -> " << dest << ": WCL "
+               << (valid ? bound.maxLatency.dbl() * 1e3 : -1) << " ms, jitter "
+               << (valid ? (bound.maxLatency - bound.minLatency).dbl() * 1e3 : -1) << " ms" << endl;
+        }
+    }
+    
+    // Ogni receiverApp del nodo riceve i limiti dei flussi che accetta (flowId vuoto = tutti)
+    for (const auto& entry : perNode) {
+        cModule *node = findNode(entry.first);
+        if (!node) continue;
+        for (cModule::SubmoduleIterator it(node); !it.end(); ++it) {
+            cModule *rx = *it;
+            if (std::string(rx->getName()) != "receiverApp" || !rx->hasPar("analyticBounds")) continue;
+            std::string filter = rx->par("flowId").stringValue();
+            std::string bounds;
+            for (const auto& flowBounds : entry.second) {
+                if (!filter.empty() && filter != flowBounds.first) continue;
+                if (!bounds.empty()) bounds += ",";
+                bounds += flowBounds.second;
+            }
+            if (!bounds.empty()) applyParam(rx, "analyticBounds", iniString(bounds));
         }
     }
 }
@@ -437,7 +1691,7 @@ void TDMAScheduler::configureSwitches() {
         std::string pStr = std::to_string(port);
         if (switchTables[sw][mac].empty()) {
             switchTables[sw][mac] = pStr;
-        } else if (switchTables[sw][mac].find(pStr) == std::string::npos) {
+        } else if ((";" + switchTables[sw][mac] + ";").find(";" + pStr + ";") == std::string::npos) {
             switchTables[sw][mac] += ";" + pStr;
         }
     };
@@ -474,53 +1728,33 @@ void TDMAScheduler::configureSwitches() {
         }
     }
     
-    // Gestione multicast: raccogli tutte le destinazioni multicast dai flow
-    // e aggiungi entry "multicast" con le porte necessarie
-    std::set<std::string> multicastDestinations;
+    // Multicast: un gruppo per flusso, con le sole porte verso le sue destinazioni
     for (const auto& flow : flows) {
-        if (flow.dstMac == "multicast") {
-            // Parse destinazioni
-            std::stringstream ss(flow.dst);
-            std::string d;
-            while (std::getline(ss, d, ',')) {
-                multicastDestinations.insert(d);
-            }
-        }
-    }
-    
-    // Per ogni switch, aggiungi porte multicast
-    if (!multicastDestinations.empty()) {
+        if (!tdma::isMulticast(tdma::parseMac(flow.dstMac))) continue;
+        std::vector<std::string> destinations = splitDestinations(flow.dst);
+
         for (const auto& adjEntry : adjacency) {
             const std::string& switchName = adjEntry.first;
             if (switchName.find("switch") == std::string::npos) continue;
-            
-            std::set<int> multicastPorts;
-            
-            for (const std::string& dest : multicastDestinations) {
+
+            for (const std::string& dest : destinations) {
                 std::vector<std::string> path = getPathTo(switchName, dest);
                 if (path.size() < 2) continue;
-                
-                std::string nextHop = path[1];
-                
+
                 for (const auto& neighborPair : adjacency[switchName]) {
-                    if (neighborPair.first == nextHop) {
-                        multicastPorts.insert(neighborPair.second);
+                    if (neighborPair.first == path[1]) {
+                        addEntry(switchName, flow.dstMac, neighborPair.second);
                         break;
                     }
                 }
             }
-            
-            // Aggiungi tutte le porte multicast
-            for (int port : multicastPorts) {
-                addEntry(switchName, "multicast", port);
-            }
         }
     }
     
     // Applica configurazione agli switch
     for (const auto& tableEntry : switchTables) {
         const std::string& switchName = tableEntry.first;
-        cModule* sw = getParentModule()->getSubmodule(switchName.c_str());
+        cModule* sw = findNode(switchName);
         if (!sw) continue;
         
         std::stringstream config;
@@ -531,7 +1765,7 @@ void TDMAScheduler::configureSwitches() {
             first = false;
         }
         
-        sw->par("macTableConfig").setStringValue(config.str());
+        applyParam(sw, "macTableConfig", iniString(config.str()));
         EV << "Switch " << switchName << " MAC table: " << config.str() << endl;
     }
     
@@ -539,6 +1773,242 @@ void TDMAScheduler::configureSwitches() {
               << switchTables.size() << " switch" << std::endl;
 }
 
+// Finestre riservate di un link riportate in [0, hyperperiod), ordinate e fuse: prenotazione
+// con la guard finale gia' inclusa, estesa (leadingGuard) di una guard iniziale per l'errore dei clock
+std::vector<std::pair<simtime_t, simtime_t>> TDMAScheduler::mergedWindows(const std::string& linkId,
+        const std::vector<LinkReservation>& reservations, bool leadingGuard) const {
+    typedef std::pair<simtime_t, simtime_t> Window;
+    simtime_t guard = leadingGuard ? guardFor(linkId) : SIMTIME_ZERO;
+    
+    std::vector<Window> windows;
+    for (const auto& res : reservations) {
+        simtime_t start = res.start - guard;
+        simtime_t end = res.end;
+        if (end - start >= hyperperiod) {
+            windows.clear();
+            windows.push_back({0, hyperperiod});
+            break;
+        }
+        int64_t shift = (int64_t)floor(start / hyperperiod);
+        start -= hyperperiod * shift;
+        end -= hyperperiod * shift;
+        if (end > hyperperiod) {
+            windows.push_back({start, hyperperiod});
+            windows.push_back({0, end - hyperperiod});
+        } else {
+            windows.push_back({start, end});
+        }
+    }
+    std::sort(windows.begin(), windows.end());
+    
+    std::vector<Window> merged;
+    for (const auto& window : windows) {
+        if (!merged.empty() && window.first <= merged.back().second) {
+            if (window.second > merged.back().second) merged.back().second = window.second;
+        } else {
+            merged.push_back(window);
+        }
+    }
+    return merged;
+}
+
+std::string TDMAScheduler::reservedWindowSpec(const std::string& linkId,
+                                              const std::vector<LinkReservation>& reservations,
+                                              simtime_t& reserved) const {
+    std::stringstream spec;
+    reserved = 0;
+    for (const auto& window : mergedWindows(linkId, reservations)) {
+        if (spec.tellp() > 0) spec << ";";
+        spec << window.first.str() << ":" << window.second.str();
+        reserved += window.second - window.first;
+    }
+    return spec.str();
+}
+
+// Finestre per nodo trasmittente e per modo. Switch: "porta->finestre,...";
+// EndSystem: finestre del link di accesso, sul MAC
+void TDMAScheduler::configureGates() {
+    std::map<std::string, std::vector<std::string>> nodeWindows;
+    double freeShareSum = 0;
+    
+    for (size_t m = 0; m < modes.size(); m++) {
+        for (const auto& entry : modes[m].linkTable) {
+            const std::string& linkId = entry.first;
+            simtime_t reserved;
+            std::string spec = reservedWindowSpec(linkId, entry.second, reserved);
+            if (m == 0) freeShareSum += 1 - reserved / hyperperiod;
+            
+            std::string u = linkId.substr(0, linkId.find("->"));
+            std::string v = linkId.substr(linkId.find("->") + 2);
+            std::vector<std::string>& specs = nodeWindows[u];
+            specs.resize(modes.size());
+            
+            if (u.find("switch") == std::string::npos) {
+                specs[m] = spec;
+                continue;
+            }
+            for (const auto& neighborPair : adjacency[u]) {
+                if (neighborPair.first != v) continue;
+                if (!specs[m].empty()) specs[m] += ",";
+                specs[m] += std::to_string(neighborPair.second) + "->" + spec;
+                break;
+            }
+        }
+    }
+    
+    for (const auto& entry : nodeWindows) {
+        const std::string& node = entry.first;
+        cModule *target = findNode(node.find("switch") != std::string::npos ? node : node + ".mac");
+        if (!target || !target->hasPar("reservedWindows")) continue;
+        
+        applyParam(target, "reservedWindows", iniString(entry.second[0]));
+        applyParam(target, "hyperperiod", iniSeconds(hyperperiod));
+        if (modes.size() > 1) {
+            std::string table;
+            for (size_t m = 0; m < modes.size(); m++) {
+                if (m > 0) table += "|";
+                table += entry.second[m];
+            }
+            applyParam(target, "modeReservedWindows", iniString(table));
+            applyParam(target, "modeSwitches", iniString(modeSwitchConfig));
+            modeTargets.push_back(target);
+        }
+    }
+    
+    if (!modes[0].linkTable.empty()) {
+        std::cout << "TDMA SCHEDULER: finestre riservate su " << modes[0].linkTable.size() << " link, quota libera media "
+                  << 100 * freeShareSum / modes[0].linkTable.size() << "%" << std::endl;
+    }
+}
+
+// Idle slope per porta di uscita e classe: banda media dei flussi shaped che la attraversano
+// (frammenti con overhead Ethernet per periodo, tutti i modi) per cbsReservationFactor.
+// Il credito e' congelato nelle finestre riservate: la banda e' ammessa sulla quota libera
+// del link (modo peggiore) e l'idle slope scalato di conseguenza. Switch: "porta->classe:bps;...,porta->..."; EndSystem: "classe:bps;..." sul MAC
+void TDMAScheduler::configureShapers() {
+    double factor = par("cbsReservationFactor").doubleValue();
+    std::map<std::string, std::vector<double>> linkSlopes;
+    int shapedFlows = 0;
+    
+    for (const auto& flow : flows) {
+        if (!flow.shaped) continue;
+        shapedFlows++;
+        
+        std::set<std::string> links;
+        for (const auto& dest : splitDestinations(flow.dst)) {
+            std::vector<std::string> path = getPathTo(flow.src, dest);
+            for (size_t i = 0; i + 1 < path.size(); i++) links.insert(path[i] + "->" + path[i + 1]);
+        }
+        double bps = factor * flow.fragmentCount * (flow.payload + tdma::ETHERNET_OVERHEAD) * 8 / flow.period.dbl();
+        int cls = std::min(std::max(flow.priority, 0), tdma::NUM_TRAFFIC_CLASSES - 1);
+        for (const auto& linkId : links) {
+            std::vector<double>& slopes = linkSlopes[linkId];
+            slopes.resize(tdma::NUM_TRAFFIC_CLASSES, 0.0);
+            slopes[cls] += bps;
+        }
+    }
+    if (shapedFlows == 0) return;
+    
+    std::map<std::string, std::string> nodeSpecs;
+    for (const auto& entry : linkSlopes) {
+        const std::string& linkId = entry.first;
+        auto rate = linkDatarate.find(linkId);
+        double capacity = rate != linkDatarate.end() ? rate->second : datarate;
+        
+        double freeShare = 1;
+        for (const auto& mode : modes) {
+            auto reservations = mode.linkTable.find(linkId);
+            if (reservations == mode.linkTable.end()) continue;
+            simtime_t reserved;
+            reservedWindowSpec(linkId, reservations->second, reserved);
+            freeShare = std::min(freeShare, 1 - reserved / hyperperiod);
+        }
+        
+        std::stringstream spec;
+        double total = 0;
+        for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+            if (entry.second[c] <= 0) continue;
+            total += entry.second[c];
+            if (freeShare <= 0) continue;
+            if (spec.tellp() > 0) spec << ";";
+            spec << c << ":" << (long long)ceil(entry.second[c] / freeShare);
+        }
+        if (total >= capacity * freeShare) {
+            throw cRuntimeError("Flussi shaped su %s: %.0f bps oltre la capacita' libera dalle finestre TDMA "
+                                "%.0f bps (%.0f bps, quota libera %.1f%%)",
+                                linkId.c_str(), total, capacity * freeShare, capacity, 100 * freeShare);
+        }
+        
+        std::string u = linkId.substr(0, linkId.find("->"));
+        std::string v = linkId.substr(linkId.find("->") + 2);
+        std::string& nodeSpec = nodeSpecs[u];
+        if (u.find("switch") == std::string::npos) {
+            nodeSpec = spec.str();
+            continue;
+        }
+        for (const auto& neighborPair : adjacency[u]) {
+            if (neighborPair.first != v) continue;
+            if (!nodeSpec.empty()) nodeSpec += ",";
+            nodeSpec += std::to_string(neighborPair.second) + "->" + spec.str();
+            break;
+        }
+    }
+    
+    for (const auto& entry : nodeSpecs) {
+        const std::string& node = entry.first;
+        cModule *target = findNode(node.find("switch") != std::string::npos ? node : node + ".mac");
+        if (!target || !target->hasPar("cbsIdleSlopes")) continue;
+        applyParam(target, "cbsIdleSlopes", iniString(entry.second));
+        EV << "CBS " << node << ": " << entry.second << endl;
+    }
+    std::cout << "TDMA SCHEDULER: " << shapedFlows << " flussi shaped, credit-based shaper su "
+              << linkSlopes.size() << " link" << std::endl;
+}
+
+// Sorgenti best-effort: nessuno slot, solo indirizzi e un flowIndex dopo quelli schedulati
+void TDMAScheduler::configureBestEffort() {
+    int nextIndex = flows.size();
+    cModule *network = getParentModule();
+    
+    for (cModule::SubmoduleIterator it(network); !it.end(); ++it) {
+        cModule *node = *it;
+        for (cModule::SubmoduleIterator appIt(node); !appIt.end(); ++appIt) {
+            cModule *app = *appIt;
+            if (std::string(app->getName()) != "beApp") continue;
+            
+            std::string dst = app->par("dstNode").stringValue();
+            if (dst.empty()) continue;
+            
+            auto mac = nodeMacAddress.find(dst);
+            cModule *dstNode = findNode(dst);
+            if (mac == nodeMacAddress.end() || !dstNode) {
+                throw cRuntimeError("%s: dstNode '%s' non e' un EndSystem con MAC", app->getFullPath().c_str(), dst.c_str());
+            }
+            if (!dstNode->getSubmodule("receiverApp", 0)) {
+                throw cRuntimeError("%s: dstNode '%s' senza receiverApp", app->getFullPath().c_str(), dst.c_str());
+            }
+            
+            if (std::string(app->par("flowId").stringValue()).empty()) {
+                applyParam(app, "flowId", iniString("be_" + std::string(node->getFullName()) +
+                                                    "_" + std::to_string(app->getIndex())));
+            }
+            applyParam(app, "srcAddr", iniString(node->par("macAddress").stringValue()));
+            applyParam(app, "dstAddr", iniString(mac->second));
+            applyParam(app, "flowIndex", std::to_string(nextIndex++));
+        }
+    }
+    
+    if (nextIndex > (int)flows.size()) {
+        std::cout << "TDMA SCHEDULER: " << nextIndex - flows.size() << " sorgenti best-effort" << std::endl;
+    }
+}
+
 void TDMAScheduler::handleMessage(cMessage *msg) {
-    delete msg;
+    if (msg == cycleTimer) {
+        checkSteadyState();
+    } else if (msg == stopTimer) {
+        endSimulation();
+    } else {
+        delete msg;
+    }
 }
@@ -4,24 +4,55 @@
 #include <omnetpp.h>
 #include <vector>
 #include <map>
+#include <set>
 #include <string>
+#include <chrono>
+#include <sstream>
+#include "../common/SteadyState.h"
 
 using namespace omnetpp;
 
+struct Job;
+
 class TDMAScheduler : public cSimpleModule {
 public:
+    // Limiti analitici di un ramo (sorgente -> una destinazione) dallo schedule
+    struct DestinationBound {
+        simtime_t maxLatency;                 // Max (arrivo - inizio slot) sui frammenti
+        simtime_t minLatency = SIMTIME_MAX;
+        simtime_t maxBurstLatency;            // Primo slot del burst -> arrivo ultimo frammento
+    };
+    
     // Definizione di un flusso di traffico
     struct Flow {
         std::string id;           // ID univoco (es "flow1_LD1")
+        int index = -1;           // Indice denso, trasportato nei frame
         std::string src;          // Nome nodo sorgente (es "LD1")
         std::string dst;          // Nome nodi destinazione (comma-separated es "HU" o "S1,S2")
         std::string srcMac;
         std::string dstMac;       
         simtime_t period;         // Periodo di trasmissione
         int payload;              // Payload del frammento in byte
-        simtime_t txTime;         // Tempo TX calcolato
+        simtime_t txTime;         // Tempo TX calcolato sul primo link
         bool isFragmented = false;
         int fragmentCount = 1;    // Numero frammenti
+        int messageSize = 0;      // Messaggio applicativo (0 = payload x burstSize del sender)
+        int messageFragments = 1; // Frammenti per messaggio (per evento se sporadico)
+        int lastPayload;          // Payload dell'ultimo frammento del messaggio
+        simtime_t relativeDeadline;   // Deadline relativa al rilascio del job (min tra maxLatency e periodo)
+        simtime_t latencyBound;       // Max (arrivo a destinazione - inizio slot) pianificato
+        std::map<std::string, DestinationBound> bounds;  // Per nodo destinazione
+        int unscheduledJobs = 0;      // Istanze rifiutate, su tutti i modi
+        simtime_t ncBound;            // Network calculus senza schedule (FIFO aggregato)
+        uint64_t modeMask = ~0ULL;    // Modi operativi in cui il flusso e' attivo
+        int priority = 3;             // Classe di traffico
+        bool shaped = false;          // Credit-based shaper: nessuno slot, banda riservata per classe
+        bool sporadic = false;        // Eventi serviti da un server periodico (period = periodo server)
+        simtime_t minInterArrival;    // Tempo minimo tra due eventi
+        int serverBudget = 1;         // Eventi per job del server (fragmentCount = budget x burstSize)
+        simtime_t responseBound = -1; // Max evento -> arrivo a destinazione (-1 = non limitato)
+        simtime_t minSlack = SIMTIME_MAX; // Min (deadline - ultimo arrivo) sui job piazzati
+        int zone = -1;                // Zona di tutti i nodi dei percorsi (-1 = attraversa il backbone)
     };
     
     enum SlotType {
@@ -32,14 +63,50 @@ public:
     struct Slot {
         std::string flowId;
         std::string node;         // Nodo che trasmette in questo slot
+        std::string link;         // Link "u->v" occupato dallo slot
         simtime_t offset;         // Offset dall'inizio dell'hyperperiod
         simtime_t duration;
         SlotType type;
+        simtime_t release;        // Rilascio del job servito dallo slot
+        simtime_t deadline;       // Deadline assoluta del job
+    };
+    
+    // Prenotazione di un link per un intervallo temporale
+    struct LinkReservation {
+        simtime_t start;
+        simtime_t end;
+    };
+    
+    // Secondo livello dello scheduling gerarchico, per zona (sommato sui modi)
+    struct ZoneTelemetry {
+        int links = 0;
+        long jobs = 0;                // Job locali piazzati o rifiutati nella zona
+        double budget = 1;            // Quota libera minima dei link di zona dopo il backbone
+        double seconds = 0;           // Wall time del piazzamento locale
+    };
+    
+    // Stato di un link nella tabella di un modo
+    struct LinkTelemetry {
+        std::string link;
+        std::string mode;
+        double utilization;       // Quota prenotata dell'hyperperiod, senza la guard iniziale dei gate
+        simtime_t largestGap;     // Intervallo libero piu' lungo, a cavallo del ciclo compreso
+    };
+    
+    // Schedule precalcolato di un modo operativo
+    struct ModeTable {
+        std::string name;
+        std::vector<Slot> schedule;
+        std::map<std::string, std::vector<LinkReservation>> linkTable;
+        int spilledReservations = 0;  // Oltre l'hyperperiod (solo import): errore con piu' modi
+        std::set<std::pair<int, int64_t>> rejected;   // Istanze (flusso, rilascio raw) non piazzabili entro la deadline
     };
 
 protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    virtual void handleParameterChange(const char *name) override;
     
 private:
     simtime_t hyperperiod;
@@ -47,9 +114,64 @@ private:
     double guardTime;
     double switchDelay;
     double propagationDelay;
+    bool adaptiveGuard;
+    std::string grandmaster;
+    
+    // Scheduling gerarchico: zona per nodo (switch da parametro, EndSystem dallo switch di accesso)
+    bool zonalScheduling;
+    std::map<std::string, int> nodeZone;
+    int numZones;
+    std::vector<ZoneTelemetry> zoneTelemetry;
+    
+    // Prestazioni del simulatore (baseline per gli studi parametrici)
+    bool recordPerformance;
+    std::chrono::steady_clock::time_point wallStart;
+    double scheduleWallTime;         // Secondi spesi in initialize()
+    
+    // Telemetria: wall time per fase (sommato sui modi), piazzamento dei job, link
+    std::vector<std::pair<std::string, double>> phaseTimes;
+    std::chrono::steady_clock::time_point phaseStart;
+    long jobsTotal;
+    long placementAttempts;          // Istanti candidati valutati, su tutti i job
+    long maxAttemptsPerJob;
+    long failedJobs;                 // Frammenti non piazzabili (l'intera istanza e' rifiutata)
+    int criticalPriority;            // Classi <= criticalPriority: un rifiuto e' un errore
+    std::vector<LinkTelemetry> linkTelemetry;
     
     std::vector<Flow> flows;
-    std::vector<Slot> schedule;
+    std::vector<Slot> schedule;      // Tabelle di lavoro del modo in calcolo
+    
+    // Modi operativi (il primo e' quello iniziale), tutti schedulati in initialize()
+    std::vector<ModeTable> modes;
+    std::string modeSwitchConfig;    // "ciclo:modo:richiesta,..." distribuito a sender, MAC e switch
+    std::vector<cModule*> modeTargets;   // Moduli con modeSwitches, aggiornati dalle richieste a runtime
+    long lastModeCycle;              // Ciclo dell'ultimo cambio richiesto (uno per hyperperiod)
+    long modeRequestsAccepted;
+    long modeRequestsRejected;
+    
+    // Esito della validazione, sommato sui modi (per tipo di problema)
+    std::vector<int> validationIssues;
+    simtime_t lastModeActivation;
+    
+    bool analyticOnly;               // Solo limiti analitici, nessun evento simulato
+    
+    // Fast-forward in regime periodico: controllo a ogni confine di hyperperiod
+    bool fastForward;
+    int steadyStateCycles;
+    int stableCycles;
+    cMessage *cycleTimer;
+    cMessage *stopTimer;
+    std::vector<tdma::ISteadyState*> participants;
+    simtime_t steadyStateAt;         // Confine in cui il regime e' stato riconosciuto
+    long cyclesSkipped;
+    simtime_t fastForwarded;
+    
+    // Prenotazioni per link "u->v", ordinate per inizio (stato dell'istanza, nessuna tabella globale)
+    std::map<std::string, std::vector<LinkReservation>> linkTable;
+    
+    // Export della configurazione applicata, in sintassi ini
+    std::string configExportFile;
+    std::ostringstream exportedConfig;
     
     // Topologia dinamica
     // Grafo: nodo -> lista di (nodo_vicino, porta_locale)
@@ -61,14 +183,64 @@ private:
     // Cache dei path calcolati (src,dst) -> path
     std::map<std::pair<std::string, std::string>, std::vector<std::string>> pathCache;
     
+    // Datarate per link "u->v" letto dal canale
+    std::map<std::string, double> linkDatarate;
+    std::map<std::string, int> linkMtu;         // Byte di payload per frame, dal canale
+    
+    // Guard band per link "u->v" (solo con adaptiveGuard)
+    std::map<std::string, simtime_t> linkGuard;
+    
     // Discovery e setup
     void discoverTopology();         // Legge topologia dal NED
     void discoverFlowsFromNetwork(); // Legge i parametri .ini dai moduli
-    void generateOptimizedSchedule();// Algoritmo EDF pipelined
+    void computeGuardBands();        // Guard minime dalla precisione dei clock
+    void generateOptimizedSchedule(int mode); // Criticita' poi EDF, pipelined sui flussi del modo
+    void placeJobs(std::vector<Job>& jobs, int mode);   // Piazzamento sulla linkTable corrente
+    void scheduleZones(std::vector<Job>& jobs, int mode); // Backbone, poi ogni zona nel proprio budget
+    void rejectJob(const Job& job, int mode);
+    void resolveModeRequests();      // Richieste di cambio modo -> confini di hyperperiod
+    void addModeSwitch(const std::string& name, simtime_t at, long cycle);
+    void validateModes();            // Verifica indipendente di ogni tabella (ScheduleValidator)
+    void exportSchedule(const std::string& file) const;
+    void importSchedule(const std::string& file);
+    int releasesPerCycle(const Flow& flow) const;
+    simtime_t accessTxTime(const Flow& flow);
+    int pathMtu(const Flow& flow);
+    void fragmentMessage(Flow& flow);
     void configureSenders();         // Inietta slot nei TDMASenderApp
     void configureSwitches();        // Configura MAC table degli switch
+    void configureReceivers();       // Limiti analitici per ramo alle receiverApp
+    void configureGates();           // Finestre riservate per link a MAC e switch (best-effort)
+    void configureBestEffort();      // Indirizzi e flowIndex delle sorgenti best-effort
+    void configureShapers();         // Idle slope CBS per porta e classe dai flussi shaped
+    void computeNetworkCalculusBounds(); // Limite FIFO senza schedule, per confronto
+    void computeResponseBounds();    // Tempo di risposta dei flussi sporadici dai job del server
+    void recordPerformanceStats();   // Wall time, eventi/s, picco RSS
+    void endPhase(const char *name); // Wall time dalla fase precedente
+    void collectLinkTelemetry();
+    void recordTelemetry();
+    void writeTelemetry(const std::string& file) const;
+    std::vector<std::pair<simtime_t, simtime_t>> mergedWindows(const std::string& linkId,
+                                                               const std::vector<LinkReservation>& reservations,
+                                                               bool leadingGuard = true) const;
+    std::string reservedWindowSpec(const std::string& linkId, const std::vector<LinkReservation>& reservations,
+                                   simtime_t& reserved) const;
+    void applyParam(cModule *module, const char *name, const std::string& value);
+    void writeConfigExport();
+    void checkSteadyState();         // Confronto cicli e, in regime, estrapolazione
+    
+    bool isLinkFree(const std::string& linkId, simtime_t start, simtime_t duration, simtime_t guard,
+                    simtime_t& freeAt) const;
+    void reserveLink(const std::string& linkId, simtime_t start, simtime_t duration, simtime_t guard);
+    void releaseLink(const std::string& linkId, simtime_t start);
+    void assignZones();
+    int linkZone(const std::string& linkId) const;
     
-    simtime_t calculateTxTime(int payloadBytes);
+    simtime_t calculateTxTime(int payloadBytes, double linkRate) const;
+    simtime_t txTimeOn(const std::string& linkId, int payloadBytes) const;
+    simtime_t guardFor(const std::string& linkId) const;
+    cModule *findNode(const std::string& name) const;
+    void applyGeneratedFlows();
     std::vector<std::string> getPathTo(const std::string& src, const std::string& dst);
 };
 
@@ -0,0 +1,84 @@
+// Implementazione sorgente best-effort
+#include "TDMABestEffortApp.h"
+#include "../../../messages/TDMAFrame_m.h"
+#include "../../../core/common/MacAddress.h"
+#include <algorithm>
+
+Define_Module(TDMABestEffortApp);
+
+void TDMABestEffortApp::initialize() {
+    flowId = par("flowId").stringValue();
+    flowIndex = par("flowIndex");
+    srcAddr = tdma::parseMac(par("srcAddr").stringValue());
+    dstAddr = tdma::parseMac(par("dstAddr").stringValue());
+    priority = par("priority");
+    stopTime = par("stopTime");
+    
+    packetsSent = 0;
+    bytesSent = 0;
+    sequence = 0;
+    sendTimer = new cMessage("BeSend");
+    
+    // Senza destinazione la sorgente resta inattiva
+    if (dstAddr == tdma::MAC_UNSPECIFIED) return;
+    if (flowIndex < 0) {
+        throw cRuntimeError("TDMABestEffortApp %s senza flowIndex (scheduler disabilitato?)", flowId.c_str());
+    }
+    
+    simtime_t start = par("startTime");
+    scheduleAt(std::max(simTime(), start) + par("interArrivalTime").doubleValue(), sendTimer);
+    
+    EV << "=== TDMABestEffortApp " << flowId << " -> " << tdma::formatMac(dstAddr) << " ===" << endl;
+}
+
+void TDMABestEffortApp::handleMessage(cMessage *msg) {
+    if (msg == sendTimer) {
+        sendFrame();
+        scheduleNext();
+    }
+}
+
+void TDMABestEffortApp::sendFrame() {
+    TDMAFrame *frame = new TDMAFrame(flowId.c_str());
+    frame->setSrcAddr(srcAddr);
+    frame->setDstAddr(dstAddr);
+    frame->setFlowIndex(flowIndex);
+    frame->setPriority(priority);
+    frame->setSequenceNumber(sequence++);
+    frame->setTrafficType(TRAFFIC_BEST_EFFORT);
+    frame->setFragmentNumber(0);
+    frame->setTotalFragments(1);
+    frame->setLastFragment(true);
+    frame->setBurstNumber(packetsSent);
+    frame->setGenTime(simTime());
+    frame->setBurstGenTime(simTime());
+    frame->setByteLength(par("payloadSize").intValue());
+    
+    bytesSent += frame->getByteLength();
+    packetsSent++;
+    send(frame, "out");
+}
+
+void TDMABestEffortApp::scheduleNext() {
+    simtime_t next = simTime() + par("interArrivalTime").doubleValue();
+    if (stopTime < 0 || next < stopTime) {
+        scheduleAt(next, sendTimer);
+    }
+}
+
+// Arrivi casuali: il regime periodico non viene riconosciuto e il fast-forward non scatta
+void TDMABestEffortApp::visitCycle(tdma::CycleTracker& t) {
+    t.counter(packetsSent);
+    t.counter(bytesSent);
+}
+
+void TDMABestEffortApp::finish() {
+    recordScalar("packetsSent", packetsSent);
+    recordScalar("bytesSent", bytesSent, "B");
+    simtime_t elapsed = simTime() + fastForwarded;
+    if (elapsed > 0) {
+        recordScalar("offeredLoad", bytesSent * 8 / elapsed.dbl(), "bps");
+    }
+    cancelAndDelete(sendTimer);
+    EV << flowId << " sent " << packetsSent << " best-effort frames" << endl;
+}
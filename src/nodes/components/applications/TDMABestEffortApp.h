@@ -0,0 +1,35 @@
+#ifndef TDMA_BEST_EFFORT_APP_H
+#define TDMA_BEST_EFFORT_APP_H
+
+#include <omnetpp.h>
+#include <string>
+#include "../../../core/common/SteadyState.h"
+
+using namespace omnetpp;
+
+class TDMABestEffortApp : public cSimpleModule, public tdma::SteadyStateParticipant {
+protected:
+    std::string flowId;
+    int flowIndex;
+    uint64_t srcAddr;
+    uint64_t dstAddr;
+    int priority;
+    simtime_t stopTime;
+    
+    long packetsSent;
+    long bytesSent;             // Carico offerto
+    uint32_t sequence;
+    
+    cMessage *sendTimer;
+    
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    virtual void visitCycle(tdma::CycleTracker& t) override;
+
+private:
+    void sendFrame();
+    void scheduleNext();
+};
+
+#endif
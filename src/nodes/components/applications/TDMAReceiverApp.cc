@@ -1,109 +1,394 @@
 // Implementazione receiver
 #include "TDMAReceiverApp.h"
 #include "../../../messages/TDMAFrame_m.h"
+#include <sstream>
+#include <limits>
 
 Define_Module(TDMAReceiverApp);
 
 void TDMAReceiverApp::initialize() {
+    profiling = par("profileEvents");
+    if (profiling) tdma::EventProfiler::instance().attach();
     flowId = par("flowId").stringValue();
+    vectorSampling = par("vectorSampling");
+    verificationTolerance = par("verificationTolerance");
+    stopOnViolation = par("stopOnViolation");
+    parseAnalyticBounds(par("analyticBounds").stringValue());
     
     maxDelayTotal = 0;
     maxJitterTotal = 0;
     lastPacketTimeTotal = -1;
+    samplesTotal = 0;
 
-    delayVectorTotal = new cOutVector("e2eDelay_TOTAL");
-    jitterVectorTotal = new cOutVector("jitter_TOTAL");
+    // Vector solo se richiesto: gli istogrammi coprono la distribuzione a memoria costante
+    delayVectorTotal = nullptr;
+    jitterVectorTotal = nullptr;
+    if (vectorSampling > 0) {
+        delayVectorTotal = new cOutVector("e2eDelay_TOTAL");
+        jitterVectorTotal = new cOutVector("jitter_TOTAL");
+    }
     
     EV << "TDMAReceiverApp " << getFullPath() << " initialized" << endl;
 }
 
+TDMAReceiverApp::FlowStats& TDMAReceiverApp::registerFlow(int index, const char *name, bool bestEffort) {
+    if (index >= (int)flowSlot.size()) {
+        flowSlot.resize(index + 1, -1);
+    }
+    flowSlot[index] = flowStats.size();
+    flowStats.emplace_back();
+    
+    FlowStats& stats = flowStats.back();
+    stats.name = name;
+    stats.bestEffort = bestEffort;
+    stats.accepted = flowId.empty() || flowId == stats.name;
+    
+    if (stats.accepted && vectorSampling > 0) {
+        stats.delayVector = new cOutVector(("e2eDelay_" + stats.name).c_str());
+        stats.jitterVector = new cOutVector(("jitter_" + stats.name).c_str());
+        EV << "Registrati vector per flow: " << stats.name << endl;
+    }
+    return stats;
+}
+
 void TDMAReceiverApp::handleMessage(cMessage *msg) {
+    tdma::EventProfiler::Scope profile(profiling ? tdma::EventProfiler::instance().entry(profileCache, this, msg) : nullptr);
     TDMAFrame *frame = check_and_cast<TDMAFrame*>(msg);
     
+    int index = frame->getFlowIndex();
+    if (index < 0) {
+        throw cRuntimeError("Frame %s senza flowIndex (sender non configurato dallo scheduler?)",
+                            frame->getName());
+    }
+    
+    // Lookup del record senza stringhe; registrazione solo al primo frame del flusso
+    int slot = (index < (int)flowSlot.size()) ? flowSlot[index] : -1;
+    FlowStats& stats = (slot >= 0) ? flowStats[slot] : registerFlow(index, frame->getName(),
+                                                                frame->getTrafficType() == TRAFFIC_BEST_EFFORT);
+    
     // Filtra per flow ID se receiver dedicato
-    if (!flowId.empty() && strcmp(frame->getFlowId(), flowId.c_str()) != 0) {
-        EV_DEBUG << "Receiver scarta frame flowId=" << frame->getFlowId()
+    if (!stats.accepted) {
+        EV_DEBUG << "Receiver scarta frame flowId=" << stats.name
                  << " (atteso: " << flowId << ")" << endl;
         delete frame;
         return;
     }
-    
-    std::string frameFlowId = frame->getFlowId();
-
-    // Registrazione dinamica vector per nuovo flow
-    if (delayVectors.find(frameFlowId) == delayVectors.end()) {
-        delayVectors[frameFlowId] = new cOutVector(("e2eDelay_" + frameFlowId).c_str());
-        jitterVectors[frameFlowId] = new cOutVector(("jitter_" + frameFlowId).c_str());
-        maxDelayPerFlow[frameFlowId] = 0;
-        maxJitterPerFlow[frameFlowId] = 0;
-        lastPacketTimePerFlow[frameFlowId] = -1;
-        EV << "Registrati vector per flow: " << frameFlowId << endl;
-    }
 
     // Calcolo E2E delay
     simtime_t delay = simTime() - frame->getGenTime();
+    stats.rxBytes += frame->getByteLength();
     
-    if (delay > maxDelayPerFlow[frameFlowId]) {
-        maxDelayPerFlow[frameFlowId] = delay;
+    if (delay > stats.maxDelay) {
+        stats.maxDelay = delay;
     }
-    if (delay > maxDelayTotal) {
+    
+    // Il best-effort ha solo statistiche per flusso: gli aggregati restano
+    // confrontabili con le run senza traffico di fondo
+    bool total = !stats.bestEffort;
+    if (total && delay > maxDelayTotal) {
         maxDelayTotal = delay;
     }
 
-    delayVectors[frameFlowId]->record(delay);
-    delayVectorTotal->record(delay);
+    bool sampleFlow = vectorSampling > 0 && stats.samples++ % vectorSampling == 0;
+    bool sampleTotal = total && vectorSampling > 0 && samplesTotal++ % vectorSampling == 0;
+
+    stats.delayHist.collect(delay);
+    if (total) delayHistTotal.collect(delay);
+    if (sampleFlow) stats.delayVector->record(delay);
+    if (sampleTotal) delayVectorTotal->record(delay);
 
     // Calcolo jitter PDV: |delay_curr - delay_prev|
-    if (lastDelayMap.find(frameFlowId) != lastDelayMap.end()) {
-         double prevDelay = lastDelayMap[frameFlowId];
-         simtime_t jitter = fabs((delay.dbl() - prevDelay));
-         
-         if (jitter > maxJitterPerFlow[frameFlowId]) {
-            maxJitterPerFlow[frameFlowId] = jitter;
-         }
-         jitterVectors[frameFlowId]->record(jitter);
-         EV_DEBUG << frameFlowId << " delay=" << delay << ", jitter=" << jitter << endl;
-    }
-    lastDelayMap[frameFlowId] = delay.dbl();
+    if (stats.lastPacketTime >= 0) {
+        simtime_t jitter = fabs(delay - stats.lastDelay);
+        
+        if (jitter > stats.maxJitter) {
+            stats.maxJitter = jitter;
+        }
+        stats.jitterHist.collect(jitter);
+        if (sampleFlow) stats.jitterVector->record(jitter);
+        EV_DEBUG << stats.name << " delay=" << delay << ", jitter=" << jitter << endl;
+    }
+    stats.lastDelay = delay;
 
     // Jitter totale basato su inter-arrival time
-    if (lastPacketTimeTotal >= 0) {
+    if (total && lastPacketTimeTotal >= 0) {
         simtime_t interArrival = simTime() - lastPacketTimeTotal;
         simtime_t expectedInterval = frame->getTxTime();
-        simtime_t jitter = fabs((interArrival - expectedInterval).dbl());
+        simtime_t jitter = fabs(interArrival - expectedInterval);
 
         if (jitter > maxJitterTotal) {
             maxJitterTotal = jitter;
         }
-        jitterVectorTotal->record(jitter);
+        jitterHistTotal.collect(jitter);
+        if (sampleTotal) jitterVectorTotal->record(jitter);
+    }
+    
+    verifySchedule(stats, frame);
+    
+    // Riassemblaggio burst frammentati
+    if (frame->getTotalFragments() > 1) {
+        trackFragment(stats, frame);
     }
     
-    lastPacketTimePerFlow[frameFlowId] = simTime();
-    lastPacketTimeTotal = simTime();
+    stats.lastPacketTime = simTime();
+    if (total) lastPacketTimeTotal = simTime();
     
     delete frame;
 }
 
+// Confronto O(1) con i riferimenti scritti dal sender (0 = non disponibile)
+void TDMAReceiverApp::verifySchedule(FlowStats& stats, TDMAFrame *frame) {
+    simtime_t now = simTime();
+    
+    simtime_t deadline = frame->getDeadline();
+    if (deadline > 0 && now > deadline + verificationTolerance) {
+        simtime_t tardiness = now - deadline;
+        stats.deadlineMisses++;
+        if (tardiness > stats.maxTardiness) stats.maxTardiness = tardiness;
+        EV_WARN << stats.name << " deadline mancata: arrivo " << now
+                << ", deadline " << deadline << endl;
+        if (stopOnViolation) {
+            throw cRuntimeError("Flusso %s: frame ricevuto a %s oltre la deadline %s",
+                                stats.name.c_str(), now.str().c_str(), deadline.str().c_str());
+        }
+    }
+    
+    simtime_t planned = frame->getPlannedArrival();
+    if (planned > 0 && now > planned + verificationTolerance) {
+        simtime_t excess = now - planned;
+        stats.latencyViolations++;
+        if (excess > stats.maxLatencyExcess) stats.maxLatencyExcess = excess;
+        EV_WARN << stats.name << " latenza oltre lo schedule: arrivo " << now
+                << ", pianificato " << planned << endl;
+        if (stopOnViolation) {
+            throw cRuntimeError("Flusso %s: frame ricevuto a %s, pianificato entro %s",
+                                stats.name.c_str(), now.str().c_str(), planned.str().c_str());
+        }
+    }
+}
+
+void TDMAReceiverApp::trackFragment(FlowStats& stats, TDMAFrame *frame) {
+    if (!stats.bursts) stats.bursts = new BurstStats();
+    BurstStats& bursts = *stats.bursts;
+    
+    int burst = frame->getBurstNumber();
+    int fragment = frame->getFragmentNumber();
+    int total = frame->getTotalFragments();
+    if (total > MAX_FRAGMENTS) {
+        throw cRuntimeError("Flusso %s: burst di %d frammenti, massimo %d", stats.name.c_str(), total, MAX_FRAGMENTS);
+    }
+    
+    // Burst saltati senza alcun frammento ricevuto: gli ultimi restano aperti nella finestra
+    // (possono ancora arrivare), i piu' vecchi sono persi per intero
+    if (burst > bursts.highestBurst) {
+        for (int skipped = bursts.highestBurst + 1; skipped < burst; skipped++) {
+            if (skipped > burst - BURST_WINDOW) {
+                openBurst(bursts, skipped, total);
+            } else {
+                bursts.incomplete++;
+                bursts.missingFragments += total;
+                EV_DEBUG << "Burst " << skipped << " perso: 0/" << total << endl;
+            }
+        }
+        bursts.highestBurst = burst;
+    }
+    
+    BurstSlot& slot = bursts.slots[burst % BURST_WINDOW];
+    
+    // Frammento di un burst gia' completato o scaduto
+    if (burst < slot.burstNumber || (burst == slot.burstNumber && !slot.open)) {
+        bursts.lateFragments++;
+        return;
+    }
+    
+    if (burst > slot.burstNumber) openBurst(bursts, burst, total);
+    if (slot.received == 0) {
+        slot.totalFragments = total;
+        slot.genTime = frame->getBurstGenTime();
+    }
+    
+    if (fragment < 0 || fragment >= slot.totalFragments) return;
+    
+    if (slot.bitmap.test(fragment)) {
+        bursts.duplicates++;
+        return;
+    }
+    slot.bitmap.set(fragment);
+    slot.received++;
+    
+    if (fragment < slot.highestFragment) {
+        bursts.outOfOrder++;
+    } else {
+        slot.highestFragment = fragment;
+    }
+    
+    if (slot.received == slot.totalFragments) {
+        bursts.latency.collect(simTime() - slot.genTime);
+        bursts.complete++;
+        slot.open = false;
+    }
+}
+
+// Riassemblaggio di un nuovo burst nel suo slot; un burst piu' vecchio di BURST_WINDOW
+// ancora aperto nello slot viene chiuso incompleto
+void TDMAReceiverApp::openBurst(BurstStats& bursts, int burst, int total) {
+    BurstSlot& slot = bursts.slots[burst % BURST_WINDOW];
+    if (slot.open) closeBurst(bursts, slot);
+    
+    slot.burstNumber = burst;
+    slot.open = true;
+    slot.totalFragments = total;
+    slot.received = 0;
+    slot.highestFragment = -1;
+    slot.bitmap.reset();
+}
+
+void TDMAReceiverApp::closeBurst(BurstStats& bursts, BurstSlot& slot) {
+    bursts.incomplete++;
+    bursts.missingFragments += slot.totalFragments - slot.received;
+    EV_DEBUG << "Burst " << slot.burstNumber << " incompleto: "
+             << slot.received << "/" << slot.totalFragments << endl;
+    slot.open = false;
+}
+
+void TDMAReceiverApp::recordBurstStats(const FlowStats& stats) {
+    const BurstStats& bursts = *stats.bursts;
+    
+    // Burst ancora aperti a fine simulazione (in volo, non persi)
+    long pending = 0;
+    for (const auto& slot : bursts.slots) {
+        if (slot.open) pending++;
+    }
+    
+    recordScalar(("burstsComplete_" + stats.name).c_str(), bursts.complete);
+    recordScalar(("burstsIncomplete_" + stats.name).c_str(), bursts.incomplete);
+    recordScalar(("burstsPending_" + stats.name).c_str(), pending);
+    recordScalar(("fragmentsMissing_" + stats.name).c_str(), bursts.missingFragments);
+    recordScalar(("fragmentsOutOfOrder_" + stats.name).c_str(), bursts.outOfOrder);
+    recordScalar(("fragmentsDuplicate_" + stats.name).c_str(), bursts.duplicates);
+    recordScalar(("fragmentsLate_" + stats.name).c_str(), bursts.lateFragments);
+    bursts.latency.recordScalars(this, "burstLatency_" + stats.name);
+    bursts.latency.recordHistogram(this, "burstLatency_" + stats.name);
+}
+
+void TDMAReceiverApp::parseAnalyticBounds(const char *spec) {
+    std::stringstream ss(spec);
+    std::string entry;
+    while (std::getline(ss, entry, ',')) {
+        std::vector<std::string> fields;
+        std::stringstream es(entry);
+        std::string field;
+        while (std::getline(es, field, ':')) fields.push_back(field);
+        if (fields.size() != 5) {
+            throw cRuntimeError("analyticBounds: voce '%s' non valida", entry.c_str());
+        }
+        AnalyticBound bound;
+        bound.name = fields[0];
+        bound.wcl = SimTime::parse(fields[1].c_str());
+        bound.jitter = SimTime::parse(fields[2].c_str());
+        bound.burstWcl = SimTime::parse(fields[3].c_str());
+        bound.ncBound = SimTime::parse(fields[4].c_str());
+        analyticBounds.push_back(bound);
+    }
+}
+
+// Scalari in ms accanto a maxDelay_/maxJitter_/burstLatency_ (infinito = non limitato)
+void TDMAReceiverApp::recordAnalyticBounds() {
+    auto ms = [](simtime_t t) {
+        return t < 0 ? std::numeric_limits<double>::infinity() : t.dbl() * 1e3;
+    };
+    for (const auto& bound : analyticBounds) {
+        if (!flowId.empty() && flowId != bound.name) continue;
+        recordScalar(("analyticWcl_" + bound.name).c_str(), ms(bound.wcl), "ms");
+        recordScalar(("analyticJitter_" + bound.name).c_str(), ms(bound.jitter), "ms");
+        if (bound.burstWcl != 0) {
+            recordScalar(("analyticBurstWcl_" + bound.name).c_str(), ms(bound.burstWcl), "ms");
+        }
+        recordScalar(("analyticNcBound_" + bound.name).c_str(), ms(bound.ncBound), "ms");
+    }
+}
+
+// Estremi e burst aperti sono stato: in regime devono restare invariati tra i confini
+void TDMAReceiverApp::visitCycle(tdma::CycleTracker& t) {
+    for (auto& stats : flowStats) {
+        if (!stats.accepted) continue;
+        t.counter(stats.samples);
+        t.counter(stats.rxBytes);
+        t.counter(stats.deadlineMisses);
+        t.counter(stats.latencyViolations);
+        t.histogram(stats.delayHist);
+        t.histogram(stats.jitterHist);
+        t.state(stats.maxDelay.dbl());
+        t.state(stats.maxJitter.dbl());
+        t.state(stats.maxTardiness.dbl());
+        t.state(stats.maxLatencyExcess.dbl());
+        
+        if (BurstStats *bursts = stats.bursts) {
+            t.counter(bursts->highestBurst);   // Avanzato col fast-forward: nessun burst "saltato"
+            t.counter(bursts->complete);
+            t.counter(bursts->incomplete);
+            t.counter(bursts->missingFragments);
+            t.counter(bursts->outOfOrder);
+            t.counter(bursts->duplicates);
+            t.counter(bursts->lateFragments);
+            t.histogram(bursts->latency);
+            for (const auto& slot : bursts->slots) t.state(slot.open ? slot.received : -1);
+        }
+    }
+    t.counter(samplesTotal);
+    t.histogram(delayHistTotal);
+    t.histogram(jitterHistTotal);
+    t.state(maxDelayTotal.dbl());
+    t.state(maxJitterTotal.dbl());
+}
+
 void TDMAReceiverApp::finish() {
     // Scalari per-flow
-    for (const auto& entry : maxDelayPerFlow) {
-        const std::string& fid = entry.first;
-        recordScalar(("maxDelay_" + fid).c_str(), maxDelayPerFlow[fid]);
-        recordScalar(("maxJitter_" + fid).c_str(), maxJitterPerFlow[fid]);
-        EV << "Flow " << fid << ": maxDelay=" << maxDelayPerFlow[fid]
-           << ", maxJitter=" << maxJitterPerFlow[fid] << endl;
+    simtime_t elapsed = simTime() + fastForwarded;
+    for (const auto& stats : flowStats) {
+        if (!stats.accepted) continue;
+        recordScalar(("maxDelay_" + stats.name).c_str(), stats.maxDelay);
+        recordScalar(("maxJitter_" + stats.name).c_str(), stats.maxJitter);
+        recordScalar(("rxBytes_" + stats.name).c_str(), stats.rxBytes, "B");
+        if (stats.bestEffort && elapsed > 0) {
+            recordScalar(("throughput_" + stats.name).c_str(), stats.rxBytes * 8 / elapsed.dbl(), "bps");
+        }
+        stats.delayHist.recordScalars(this, "e2eDelay_" + stats.name);
+        stats.delayHist.recordHistogram(this, "e2eDelay_" + stats.name);
+        stats.jitterHist.recordScalars(this, "jitter_" + stats.name);
+        stats.jitterHist.recordHistogram(this, "jitter_" + stats.name);
+        if (stats.bursts) recordBurstStats(stats);
+        recordScalar(("deadlineMisses_" + stats.name).c_str(), stats.deadlineMisses);
+        recordScalar(("maxTardiness_" + stats.name).c_str(), stats.maxTardiness);
+        recordScalar(("latencyViolations_" + stats.name).c_str(), stats.latencyViolations);
+        recordScalar(("maxLatencyExcess_" + stats.name).c_str(), stats.maxLatencyExcess);
+        EV << "Flow " << stats.name << ": maxDelay=" << stats.maxDelay
+           << ", maxJitter=" << stats.maxJitter << endl;
     }
 
+    recordAnalyticBounds();
+
     // Scalari aggregati
     recordScalar("maxDelay_TOTAL", maxDelayTotal);
     recordScalar("maxJitter_TOTAL", maxJitterTotal);
+    delayHistTotal.recordScalars(this, "e2eDelay_TOTAL");
+    delayHistTotal.recordHistogram(this, "e2eDelay_TOTAL");
+    jitterHistTotal.recordScalars(this, "jitter_TOTAL");
+    jitterHistTotal.recordHistogram(this, "jitter_TOTAL");
 
     EV << "=== " << getFullPath() << " TOTAL ===" << endl;
     EV << "Max Delay: " << maxDelayTotal << ", Max Jitter: " << maxJitterTotal << endl;
 
     // Cleanup
-    for (auto& entry : delayVectors) delete entry.second;
-    for (auto& entry : jitterVectors) delete entry.second;
+    for (auto& stats : flowStats) {
+        delete stats.delayVector;
+        delete stats.jitterVector;
+        delete stats.bursts;
+        stats.delayVector = stats.jitterVector = nullptr;
+        stats.bursts = nullptr;
+    }
     delete delayVectorTotal;
     delete jitterVectorTotal;
+    
+    if (profiling) tdma::EventProfiler::instance().detach();
 }
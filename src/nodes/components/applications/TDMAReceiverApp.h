@@ -2,37 +2,119 @@
 #define TDMA_RECEIVER_APP_H
 
 #include <omnetpp.h>
+#include <bitset>
 #include <string>
-#include <map>
+#include <vector>
+#include "../../../core/common/LogHistogram.h"
+#include "../../../core/common/SteadyState.h"
+#include "../../../core/common/EventProfiler.h"
 
 using namespace omnetpp;
 
-class TDMAReceiverApp : public cSimpleModule {
+class TDMAFrame;
+
+class TDMAReceiverApp : public cSimpleModule, public tdma::SteadyStateParticipant {
 protected:
+    // Burst aperti contemporaneamente per flusso: un burst viene chiuso quando
+    // arriva un frammento di burstNumber + BURST_WINDOW (o quando e' completo)
+    static const int BURST_WINDOW = 4;
+    // Frammenti per burst coperti dalla bitmap (oltre: errore di configurazione)
+    static const int MAX_FRAGMENTS = 1024;
+
+    // Riassemblaggio di un burst con bitmap di dimensione fissa
+    struct BurstSlot {
+        int burstNumber = -1;        // Ultimo burst assegnato allo slot
+        bool open = false;           // Burst in riassemblaggio
+        int totalFragments = 0;
+        int received = 0;
+        int highestFragment = -1;
+        simtime_t genTime;           // Generazione del primo frammento
+        std::bitset<MAX_FRAGMENTS> bitmap;
+    };
+
+    // Statistiche burst (solo flussi frammentati)
+    struct BurstStats {
+        BurstSlot slots[BURST_WINDOW];
+        int highestBurst = -1;       // Burst piu' recente visto: i numeri saltati sono burst persi
+        long complete = 0;
+        long incomplete = 0;
+        long missingFragments = 0;
+        long outOfOrder = 0;
+        long duplicates = 0;
+        long lateFragments = 0;      // Frammenti di burst gia' chiusi
+        tdma::LogHistogram latency;  // Primo frammento generato -> ultimo ricevuto
+    };
+
+    // Statistiche di un flusso visto da questo receiver
+    struct FlowStats {
+        std::string name;
+        bool accepted = false;       // Esito del filtro flowId (valutato una sola volta)
+        bool bestEffort = false;     // Escluso dagli aggregati TOTAL (solo traffico schedulato)
+        long rxBytes = 0;
+        simtime_t maxDelay;
+        simtime_t maxJitter;
+        simtime_t lastDelay;
+        simtime_t lastPacketTime = -1;
+        long samples = 0;
+        tdma::LogHistogram delayHist;
+        tdma::LogHistogram jitterHist;
+        cOutVector *delayVector = nullptr;
+        cOutVector *jitterVector = nullptr;
+        BurstStats *bursts = nullptr; // Allocato al primo frammento di un burst
+        long deadlineMisses = 0;
+        long latencyViolations = 0;  // Arrivi oltre l'arrivo pianificato
+        simtime_t maxTardiness;      // Max ritardo oltre la deadline
+        simtime_t maxLatencyExcess;  // Max ritardo oltre l'arrivo pianificato
+    };
+
+    // Limiti analitici del ramo verso questo nodo (negativo = non limitato)
+    struct AnalyticBound {
+        std::string name;
+        simtime_t wcl;
+        simtime_t jitter;
+        simtime_t burstWcl;
+        simtime_t ncBound;
+    };
+    std::vector<AnalyticBound> analyticBounds;
+
     std::string flowId;  // Vuoto = accetta tutti i flow
+    int vectorSampling;  // 0 = nessun vector, N = un campione ogni N
+    simtime_t verificationTolerance;
+    bool profiling;             // profileEvents
+    tdma::EventProfiler::ModuleCache profileCache;
+    bool stopOnViolation;
     
-    // Statistiche flow
-    std::map<std::string, simtime_t> maxDelayPerFlow;
-    std::map<std::string, simtime_t> maxJitterPerFlow;
-    std::map<std::string, simtime_t> lastPacketTimePerFlow;
-    std::map<std::string, double> lastDelayMap; 
+    // flowIndex del frame -> posizione in flowStats (-1 = non visto).
+    // Due accessi ad array per frame, memoria proporzionale ai soli flussi ricevuti
+    std::vector<int> flowSlot;
+    std::vector<FlowStats> flowStats;
 
-    // Statistiche aggregate
+    // Statistiche aggregate del traffico schedulato
     simtime_t maxDelayTotal;
     simtime_t maxJitterTotal;
     simtime_t lastPacketTimeTotal;
-
-    // Output vectors flow
-    std::map<std::string, cOutVector*> delayVectors;
-    std::map<std::string, cOutVector*> jitterVectors;
+    long samplesTotal;
+    tdma::LogHistogram delayHistTotal;
+    tdma::LogHistogram jitterHistTotal;
     
-    // Output vectors aggregati
+    // Output vectors aggregati (campionati)
     cOutVector *delayVectorTotal;
     cOutVector *jitterVectorTotal;
     
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
+    virtual void visitCycle(tdma::CycleTracker& t) override;
+
+private:
+    FlowStats& registerFlow(int index, const char *name, bool bestEffort);
+    void verifySchedule(FlowStats& stats, TDMAFrame *frame);
+    void trackFragment(FlowStats& stats, TDMAFrame *frame);
+    void openBurst(BurstStats& bursts, int burst, int total);
+    void closeBurst(BurstStats& bursts, BurstSlot& slot);
+    void recordBurstStats(const FlowStats& stats);
+    void parseAnalyticBounds(const char *spec);
+    void recordAnalyticBounds();
 };
 
 #endif
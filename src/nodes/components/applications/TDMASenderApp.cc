@@ -2,127 +2,357 @@
 #include "TDMASenderApp.h"
 #include "../../../messages/TDMAFrame_m.h"
 #include "../../../core/common/Constants.h"
+#include "../../../core/common/MacAddress.h"
+#include "../../../core/clock/TDMAClock.h"
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 
 Define_Module(TDMASenderApp);
 
+// CSV di SimTime esatti, senza passare da double
+static std::vector<simtime_t> parseTimes(const std::string& csv) {
+    std::vector<simtime_t> times;
+    std::stringstream ss(csv);
+    std::string token;
+    while (std::getline(ss, token, ',')) {
+        times.push_back(SimTime::parse(token.c_str()));
+    }
+    return times;
+}
+
 void TDMASenderApp::initialize() {
+    profiling = par("profileEvents");
+    if (profiling) tdma::EventProfiler::instance().attach();
     flowId = par("flowId").stringValue();
-    srcAddr = par("srcAddr").stringValue();
-    dstAddr = par("dstAddr").stringValue();
+    flowIndex = par("flowIndex");
+    srcAddr = tdma::parseMac(par("srcAddr").stringValue());
+    dstAddr = tdma::parseMac(par("dstAddr").stringValue());
+    sequence = 0;
     payloadSize = par("payloadSize");
     burstSize = par("burstSize");
+    lastFragmentSize = par("lastFragmentSize");
+    if (lastFragmentSize <= 0) lastFragmentSize = payloadSize;
+    priority = par("priority");
+    shaped = std::string(par("shaping").stringValue()) == "cbs";
     
     // Parse slot list dal parametro
-    std::string slotsStr = par("tdmaSlots").stringValue();
-    if (!slotsStr.empty()) {
-        std::stringstream ss(slotsStr);
-        std::string token;
-        while (std::getline(ss, token, ',')) {
-            txSlots.push_back(SimTime(std::stod(token), SIMTIME_S));
-        }
+    txSlots = parseTimes(par("tdmaSlots").stringValue());
+    txReleases = parseTimes(par("tdmaReleases").stringValue());
+    if (!txReleases.empty() && txReleases.size() != txSlots.size()) {
+        throw cRuntimeError("tdmaReleases ha %d valori, tdmaSlots %d",
+                            (int)txReleases.size(), (int)txSlots.size());
     }
     
+    // Tabelle per modo "slot/rilasci|slot/rilasci|..." (la prima coincide con tdmaSlots)
+    for (const auto& table : tdma::ModeSchedule::splitModes(par("modeSlots").stringValue())) {
+        size_t sep = table.find('/');
+        modeTxSlots.push_back(parseTimes(table.substr(0, sep)));
+        modeTxReleases.push_back(sep != std::string::npos ? parseTimes(table.substr(sep + 1)) : std::vector<simtime_t>());
+    }
+    modeSchedule.parse(par("modeSwitches").stringValue());
+    modeLatencySignal = registerSignal("modeTransitionLatency");
+    currentMode = 0;
+    modeStartCycle = 0;
+    burstBase = 0;
+    modeSwitchesApplied = 0;
+    latencyBound = par("latencyBound");
+    relativeDeadline = par("relativeDeadline");
+    
     txDuration = par("txDuration");
     currentSlot = 0;
     packetsSent = 0;
-    currentFragment = 0;
+    slotsMissed = 0;
     hyperperiod = par("hyperperiod");
     cycleCount = 0;
+    lastBurstNumber = -1;
+    burstStartTime = 0;
+    
+    burstEmission = par("burstEmission");
+    burstGapTolerance = par("burstGapTolerance");
+    // Gli slot dello scheduler sono gia' ordinati; i rilasci sono allineati agli slot
+    if (txReleases.empty()) {
+        std::sort(txSlots.begin(), txSlots.end());
+    } else if (!std::is_sorted(txSlots.begin(), txSlots.end())) {
+        throw cRuntimeError("tdmaSlots non ordinati con tdmaReleases presente");
+    }
+    txTimer = new cMessage("TxSlot");
+    modeTimer = new cMessage("ModeSwitch");
+    
+    sporadic = par("sporadic");
+    minInterArrival = par("minInterArrival");
+    responseBound = par("responseBound");
+    serving = false;
+    eventTime = 0;
+    eventsGenerated = 0;
+    eventsServed = 0;
+    maxPendingEvents = 0;
+    eventTimer = new cMessage("SporadicEvent");
+    if (sporadic) {
+        scheduleAt(simTime() + std::max(minInterArrival, (simtime_t)par("eventInterval")), eventTimer);
+    }
+    
+    // Gli slot sono espressi in tempo locale del nodo
+    clock = dynamic_cast<TDMAClock*>(getParentModule()->getSubmodule("clock"));
     
     EV << "=== TDMASenderApp " << flowId << " ===" << endl;
     EV << "Slots: " << txSlots.size() << ", Fragments: " << burstSize << endl;
     
     if (!txSlots.empty()) {
         scheduleNextSlot();
+    } else {
+        scheduleModeWakeup();
     }
 }
 
 void TDMASenderApp::handleMessage(cMessage *msg) {
-    if (msg->isSelfMessage() && strcmp(msg->getName(), "TxSlot") == 0) {
-        delete msg;
+    tdma::EventProfiler::Scope profile(profiling ? tdma::EventProfiler::instance().entry(profileCache, this, msg) : nullptr);
+    if (msg == txTimer) {
+        sendSlotRun();
+    } else if (msg == eventTimer) {
+        generateEvent();
+    } else if (msg == modeTimer) {
+        // Inattivo fino a questo confine: riparte dal primo slot del nuovo ciclo
+        cycleCount = modeSchedule.nextCycle();
+        currentSlot = 0;
+        applyModeSwitch();
+        if (!txSlots.empty()) {
+            scheduleNextSlot();
+        } else {
+            scheduleModeWakeup();
+        }
+    }
+}
+
+// Evento sporadico in coda fino al prossimo job del server; il successivo non prima
+// di minInterArrival
+void TDMASenderApp::generateEvent() {
+    pendingEvents.push_back(simTime());
+    eventsGenerated++;
+    maxPendingEvents = std::max(maxPendingEvents, (long)pendingEvents.size());
+    scheduleAt(simTime() + std::max(minInterArrival, (simtime_t)par("eventInterval")), eventTimer);
+}
+
+// Invia il frammento dello slot corrente e, in modalita' burst, quelli degli
+// slot adiacenti dello stesso ciclo (il MAC li trasmette ciascuno all'inizio del proprio
+// slot, guard comprese); poi riarma il timer sul prossimo slot
+void TDMASenderApp::sendSlotRun() {
+    sendFragment();
+    
+    while (burstEmission && currentSlot > 0 && currentSlot < (int)txSlots.size() &&
+           txSlots[currentSlot] - txSlots[currentSlot - 1] <= txDuration + burstGapTolerance) {
         sendFragment();
     }
+    
+    scheduleNextSlot();
 }
 
 void TDMASenderApp::sendFragment() {
-    std::string currentDst = dstAddr;
-    
-    // Round-robin per multicast
-    if (dstAddr == "multicast") {
-        if (flowId.find("flow2") != std::string::npos) {
-            // Audio: S1, S2, S3, S4
-            std::vector<std::string> speakers = {
-                "00:00:00:00:00:05", "00:00:00:00:00:08", 
-                "00:00:00:00:00:0D", "00:00:00:00:00:11"
-            };
-            currentDst = speakers[currentFragment % 4]; 
-        } else if (flowId.find("flow6") != std::string::npos) {
-            // Video: RS1, RS2
-            std::vector<std::string> screens = {
-                "00:00:00:00:00:12", "00:00:00:00:00:0E"
-            };
-            currentDst = screens[currentFragment % 2];
+    // Flag ultimo frammento del burst corrente
+    int fragment = currentSlot % burstSize;
+    bool isLast = (fragment + 1 == burstSize);
+    
+    if (sporadic && fragment == 0) {
+        serving = !pendingEvents.empty();
+        if (serving) {
+            eventTime = pendingEvents.front();
+            pendingEvents.pop_front();
+            eventWait.collect(simTime() - eventTime);
+            eventsServed++;
         }
     }
-
-    // Flag ultimo frammento del burst corrente
-    bool isLast = ((currentFragment + 1) % burstSize == 0); 
+    if (sporadic && !serving) {
+        currentSlot++;
+        return;
+    }
+    
+    // Burst globale: (ciclo, indice burst nel ciclo); sporadico: un burst per evento
+    int burstsPerCycle = std::max(1, (int)txSlots.size() / burstSize);
+    int burstNumber = sporadic ? eventsServed - 1
+                               : burstBase + (cycleCount - modeStartCycle) * burstsPerCycle + currentSlot / burstSize;
+    if (burstNumber != lastBurstNumber) {
+        burstStartTime = sporadic ? eventTime : simTime();
+        lastBurstNumber = burstNumber;
+    }
 
     TDMAFrame *frame = new TDMAFrame(flowId.c_str());
-    frame->setSrcAddr(srcAddr.c_str());
-    frame->setDstAddr(currentDst.c_str());
-    frame->setFlowId(flowId.c_str());
+    frame->setSrcAddr(srcAddr);
+    frame->setDstAddr(dstAddr);
+    frame->setFlowIndex(flowIndex);
+    frame->setPriority(priority);
+    frame->setSequenceNumber(sequence++);
+    frame->setTrafficType(shaped ? TRAFFIC_SHAPED : TRAFFIC_SCHEDULED);
     frame->setSlotNumber(currentSlot);
-    frame->setFragmentNumber(currentFragment % burstSize);
+    frame->setFragmentNumber(fragment);
     frame->setTotalFragments(burstSize);
-    frame->setGenTime(simTime());
+    frame->setGenTime(sporadic ? eventTime : simTime());
     frame->setTxTime(txDuration);
     frame->setLastFragment(isLast);
-    frame->setByteLength(payloadSize);
+    frame->setBurstNumber(burstNumber);
+    frame->setBurstGenTime(burstStartTime);
+    
+    // Riferimenti per la verifica online al receiver (tempo globale)
+    simtime_t cycleStart = hyperperiod * cycleCount;
+    if (sporadic) {
+        // Riferimenti dall'evento: deadline implicita e risposta massima analitica
+        if (relativeDeadline > 0) frame->setDeadline(eventTime + relativeDeadline);
+        if (responseBound > 0) frame->setPlannedArrival(eventTime + responseBound);
+    } else if (!txReleases.empty() && relativeDeadline > 0) {
+        frame->setDeadline(cycleStart + txReleases[currentSlot] + relativeDeadline);
+    }
+    simtime_t slotStart = cycleStart + txSlots[currentSlot];
+    simtime_t slotTime = clock ? clock->toSimTime(slotStart) : slotStart;
+    if (!sporadic && latencyBound > 0) {
+        frame->setPlannedArrival(slotTime + latencyBound);
+    }
+    if (burstEmission) frame->setTxNotBefore(slotTime);
+    frame->setByteLength(isLast ? lastFragmentSize : payloadSize);
 
     send(frame, "out");
     packetsSent++;
 
-    EV_DEBUG << flowId << " frag " << (currentFragment % burstSize) 
-             << " -> " << currentDst << " @ " << simTime() << endl;
+    EV_DEBUG << flowId << " frag " << fragment
+             << " -> " << tdma::formatMac(dstAddr) << " @ " << simTime() << endl;
 
-    currentFragment++;
     currentSlot++;
-    
-    scheduleNextSlot();
 }
 
+simtime_t TDMASenderApp::localNow() const {
+    return clock ? clock->getLocalTime(simTime()) : simTime();
+}
+
+// Prossimo slot in O(1) nel caso normale; se il timer e' in ritardo di uno o piu'
+// cicli si salta direttamente al ciclo corrente (ricerca binaria sugli offset)
 void TDMASenderApp::scheduleNextSlot() {
     // Se abbiamo esaurito gli slot di questo ciclo, passa al prossimo
-    if (currentSlot >= txSlots.size()) {
+    if (currentSlot >= (int)txSlots.size()) {
         currentSlot = 0;
         cycleCount++;
-        currentFragment = 0;  // Reset frammenti per nuovo ciclo
+        applyModeSwitch();
     }
-
-    while (currentSlot < txSlots.size()) {
-        // Offset originale + shift per il ciclo corrente
-        simtime_t nextTime = txSlots[currentSlot] + (hyperperiod * cycleCount);
-        
-        if (nextTime >= simTime()) {
-            cMessage *slotMsg = new cMessage("TxSlot");
-            scheduleAt(nextTime, slotMsg);
-            return;
+    
+    int numSlots = txSlots.size();
+    if (numSlots == 0) {
+        scheduleModeWakeup();
+        return;
+    }
+    
+    simtime_t now = localNow();
+    simtime_t nextTime = txSlots[currentSlot] + (hyperperiod * cycleCount);
+    
+    if (nextTime < now) {
+        int nowCycle = (int)floor(now / hyperperiod);
+        long missed = 0;
+        if (nowCycle > cycleCount) {
+            missed += (numSlots - currentSlot) + (long)(nowCycle - cycleCount - 1) * numSlots;
+            cycleCount = nowCycle;
+            currentSlot = 0;
+            applyModeSwitch();
+            numSlots = txSlots.size();
+            if (numSlots == 0) {
+                slotsMissed += missed;
+                scheduleModeWakeup();
+                return;
+            }
         }
         
-        // Slot nel passato, salta
-        EV_WARN << flowId << " skipped slot " << currentSlot
-                << " @ " << nextTime << endl;
-        currentSlot++;
+        simtime_t cycleOffset = now - hyperperiod * cycleCount;
+        int idx = std::lower_bound(txSlots.begin() + currentSlot, txSlots.end(), cycleOffset) - txSlots.begin();
+        missed += idx - currentSlot;
+        currentSlot = idx;
+        
+        if (currentSlot >= numSlots) {
+            currentSlot = 0;
+            cycleCount++;
+            applyModeSwitch();
+            numSlots = txSlots.size();
+            if (numSlots == 0) {
+                slotsMissed += missed;
+                scheduleModeWakeup();
+                return;
+            }
+        }
+        slotsMissed += missed;
+        nextTime = txSlots[currentSlot] + (hyperperiod * cycleCount);
     }
+    
+    // Offset locale -> tempo di simulazione
+    simtime_t fireTime = clock ? clock->toSimTime(nextTime) : nextTime;
+    if (fireTime < simTime()) fireTime = simTime();
+    scheduleAt(fireTime, txTimer);
+}
 
-    // Se siamo qui, tutti gli slot del ciclo erano nel passato
-    // Riprova col prossimo ciclo
-    scheduleNextSlot();
+// Confine di ciclo: se e' attivo un nuovo modo ne carica la tabella. Le trasmissioni
+// del modo precedente si sono chiuse nel ciclo appena terminato (cambio hitless)
+void TDMASenderApp::applyModeSwitch() {
+    int previous = currentMode;
+    if (!modeSchedule.advance(cycleCount, currentMode)) return;
+    if (currentMode >= (int)modeTxSlots.size()) {
+        throw cRuntimeError("Modo %d senza tabella in modeSlots", currentMode);
+    }
+    
+    // Numerazione dei burst continua attraverso il cambio
+    int burstsPerCycle = std::max(1, (int)txSlots.size() / burstSize);
+    burstBase += (cycleCount - modeStartCycle) * burstsPerCycle;
+    modeStartCycle = cycleCount;
+    
+    txSlots = modeTxSlots[currentMode];
+    txReleases = modeTxReleases[currentMode];
+    modeSwitchesApplied++;
+    if (modeSchedule.lastRequest() >= 0) emit(modeLatencySignal, simTime() - modeSchedule.lastRequest());
+    EV << flowId << ": modo " << previous << " -> " << currentMode << " dal ciclo " << cycleCount
+       << " (" << txSlots.size() << " slot)" << endl;
+}
+
+// Cambio di modo richiesto a runtime: la lista estesa vale dal prossimo confine. Se il
+// sender e' inattivo nel modo corrente serve il risveglio
+void TDMASenderApp::handleParameterChange(const char *name) {
+    if (strcmp(name, "modeSwitches") != 0) return;
+    modeSchedule.update(par("modeSwitches").stringValue());
+    if (txSlots.empty() && !modeTimer->isScheduled()) scheduleModeWakeup();
+}
+
+// Nessuno slot nel modo corrente: attesa del prossimo confine con cambio modo
+void TDMASenderApp::scheduleModeWakeup() {
+    long cycle = modeSchedule.nextCycle();
+    if (cycle < 0) return;
+    simtime_t boundary = hyperperiod * cycle;
+    simtime_t fireTime = clock ? clock->toSimTime(boundary) : boundary;
+    scheduleAt(std::max(fireTime, simTime()), modeTimer);
+}
+
+// cycleCount resta legato a simTime(): i burst successivi al fast-forward proseguono la numerazione
+void TDMASenderApp::visitCycle(tdma::CycleTracker& t) {
+    t.counter(packetsSent);
+    t.counter(slotsMissed);
+    t.counter(modeSwitchesApplied);
+    t.state(currentSlot);
+    t.state(currentMode);
+    if (sporadic) {
+        t.counter(eventsGenerated);
+        t.counter(eventsServed);
+        t.histogram(eventWait);
+        t.state(pendingEvents.size());
+        t.state(maxPendingEvents);
+    }
 }
 
 void TDMASenderApp::finish() {
     recordScalar("packetsSent", packetsSent);
+    recordScalar("slotsMissed", slotsMissed);
+    if (!modeSchedule.empty()) recordScalar("modeSwitches", modeSwitchesApplied);
+    if (sporadic) {
+        recordScalar("eventsGenerated", eventsGenerated);
+        recordScalar("eventsServed", eventsServed);
+        recordScalar("eventsPending", pendingEvents.size());
+        recordScalar("maxPendingEvents", maxPendingEvents);
+        eventWait.recordScalars(this, "eventWait");
+        if (responseBound >= 0) recordScalar("responseBound", responseBound);
+    }
+    cancelAndDelete(txTimer);
+    cancelAndDelete(modeTimer);
+    cancelAndDelete(eventTimer);
     EV << flowId << " sent " << packetsSent << " packets" << endl;
+    
+    if (profiling) tdma::EventProfiler::instance().detach();
 }
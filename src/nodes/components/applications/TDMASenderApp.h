@@ -2,34 +2,91 @@
 #define TDMA_SENDER_APP_H
 
 #include <omnetpp.h>
+#include <deque>
 #include <vector>
 #include <string>
+#include "../../../core/common/LogHistogram.h"
+#include "../../../core/common/SteadyState.h"
+#include "../../../core/common/EventProfiler.h"
+#include "../../../core/common/ModeSchedule.h"
 
 using namespace omnetpp;
 
-class TDMASenderApp : public cSimpleModule {
+class TDMAClock;
+
+class TDMASenderApp : public cSimpleModule, public tdma::SteadyStateParticipant {
 protected:
     std::string flowId;
-    std::string srcAddr;
-    std::string dstAddr;        // MAC specifico o "multicast"
+    int flowIndex;
+    uint64_t srcAddr;
+    uint64_t dstAddr;           // MAC unicast o gruppo multicast del flusso
+    uint32_t sequence;          // Progressivo dei frame (non estrapolato dal fast-forward)
     int payloadSize;            // Byte per frammento
+    int lastFragmentSize;       // Byte dell'ultimo frammento del burst
     int burstSize;              // Frammenti totali (per header)
+    int priority;               // Classe di traffico
+    bool shaped;                // Frame al credit-based shaper invece che negli slot
     simtime_t txDuration;
+    bool profiling;             // profileEvents
+    tdma::EventProfiler::ModuleCache profileCache;
     
-    std::vector<simtime_t> txSlots;  // Offset slot da scheduler
-    int currentSlot;
+    std::vector<simtime_t> txSlots;  // Offset slot da scheduler (ordinati)
+    std::vector<simtime_t> txReleases; // Rilascio del job servito da ogni slot (vuoto = non noto)
+    simtime_t latencyBound;     // Latenza pianificata dallo scheduler
+    simtime_t relativeDeadline;
+    int currentSlot;            // Indice slot nel ciclo corrente = contatore frammenti
     long packetsSent;
-    int currentFragment;        // Contatore frammenti inviati
+    long slotsMissed;           // Slot gia' passati al momento della pianificazione
     simtime_t hyperperiod;
     int cycleCount;
+    int lastBurstNumber;        // Burst dell'ultimo frammento inviato
+    simtime_t burstStartTime;   // Generazione del primo frammento del burst corrente
+    
+    cMessage *txTimer;          // Unico timer riutilizzato per tutti gli slot
+    
+    // Modi operativi: tabelle precalcolate, cambio al confine di ciclo locale
+    std::vector<std::vector<simtime_t>> modeTxSlots;
+    std::vector<std::vector<simtime_t>> modeTxReleases;
+    tdma::ModeSchedule modeSchedule;
+    int currentMode;
+    int modeStartCycle;         // Ciclo di attivazione del modo corrente
+    int burstBase;              // Burst numerati prima del modo corrente
+    long modeSwitchesApplied;
+    cMessage *modeTimer;        // Risveglio al cambio modo se inattivo nel modo corrente
+    simsignal_t modeLatencySignal;
+    bool burstEmission;         // Slot adiacenti inviati al MAC in un solo evento
+    simtime_t burstGapTolerance;
+    
+    TDMAClock *clock;           // Clock locale del nodo (nullptr = ideale)
+    
+    // Sporadico: il primo slot di ogni evento serve il piu' vecchio in coda, altrimenti
+    // gli slot dell'evento restano vuoti
+    bool sporadic;
+    simtime_t minInterArrival;
+    simtime_t responseBound;
+    std::deque<simtime_t> pendingEvents;  // Istanti di generazione in attesa
+    bool serving;               // Slot dell'evento corrente in uso
+    simtime_t eventTime;        // Generazione dell'evento in trasmissione
+    long eventsGenerated;
+    long eventsServed;
+    long maxPendingEvents;
+    tdma::LogHistogram eventWait;   // Generazione -> primo frammento
+    cMessage *eventTimer;
     
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
+    virtual void handleParameterChange(const char *name) override;
+    virtual void visitCycle(tdma::CycleTracker& t) override;
 
 private:
     void sendFragment();
+    void sendSlotRun();
     void scheduleNextSlot();
+    void applyModeSwitch();
+    void scheduleModeWakeup();
+    simtime_t localNow() const;
+    void generateEvent();
 };
 
 #endif
@@ -2,28 +2,80 @@
 #include "TDMAMac.h"
 #include "../../../messages/TDMAFrame_m.h"
 #include "../../../core/common/Constants.h"
+#include <algorithm>
 
 Define_Module(TDMAMac);
 
 void TDMAMac::initialize() {
+    profiling = par("profileEvents");
+    if (profiling) tdma::EventProfiler::instance().attach();
     txQueue = cPacketQueue("txQueue");
     rxQueue = cPacketQueue("rxQueue");
+    beQueue = cPacketQueue("beQueue");
     
-    datarate = par("datarate").doubleValue();
+    datarate = tdma::getLinkDatarate(gate("lowerOut"), par("datarate").doubleValue());
     macAddress = par("macAddress").stringValue();
     currentRxFrame = nullptr;
+    txCompleteMsg = new cMessage("TxComplete");
+    beGateMsg = new cMessage("BeGate");
+    hyperperiod = par("hyperperiod");
+    gates.parse(par("reservedWindows").stringValue(), hyperperiod);
+    for (const auto& spec : tdma::ModeSchedule::splitModes(par("modeReservedWindows").stringValue())) {
+        modeGates.push_back(tdma::GateSchedule());
+        modeGates.back().parse(spec, hyperperiod);
+    }
+    modeSchedule.parse(par("modeSwitches").stringValue());
+    modeLatencySignal = registerSignal("modeTransitionLatency");
+    currentMode = 0;
+    modeTimer = new cMessage("ModeSwitch");
+    scheduleModeSwitch();
+    beDeferred = 0;
+    beDropped = 0;
+    
+    std::vector<double> slopes = tdma::CreditShaper::parseSlopes(par("cbsIdleSlopes").stringValue());
+    for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+        shapedQueues[c].setName(("shapedQueue" + std::to_string(c)).c_str());
+        shapers[c].configure(slopes[c], datarate);
+    }
+    shapedSending = -1;
     
     txState = TX_IDLE;
     rxState = RX_IDLE;
     
+    std::string mode = par("rxMode").stringValue();
+    if (mode == "direct") {
+        rxMode = RX_DIRECT;
+    } else if (mode == "receptionStart") {
+        rxMode = RX_RECEPTION_START;
+        // Il canale consegna il frame all'inizio della ricezione
+        gate("lowerIn")->setDeliverImmediately(true);
+    } else if (mode == "serialized") {
+        rxMode = RX_SERIALIZED;
+    } else {
+        throw cRuntimeError("Unknown rxMode '%s'", mode.c_str());
+    }
+    
     maxTxQueueSize = 0;
     maxRxQueueSize = 0;
     
+    txQueueLengthSignal = registerSignal("txQueueLength");
+    rxQueueLengthSignal = registerSignal("rxQueueLength");
+    
+    statsInterval = par("statsInterval");
+    statsTimer = nullptr;
+    if (statsInterval > 0) {
+        txStats.utilizationVector = new cOutVector("utilization");
+        statsTimer = new cMessage("StatsTick");
+        scheduleAt(simTime() + statsInterval, statsTimer);
+    }
+    
     WATCH(maxTxQueueSize);
     WATCH(maxRxQueueSize);
+    WATCH(beDeferred);
 }
 
 void TDMAMac::handleMessage(cMessage *msg) {
+    tdma::EventProfiler::Scope profile(profiling ? tdma::EventProfiler::instance().entry(profileCache, this, msg) : nullptr);
     if (msg->isSelfMessage()) {
         handleSelfMessage(msg);
     } else if (msg->getArrivalGate()->isName("upperIn")) {
@@ -34,11 +86,29 @@ void TDMAMac::handleMessage(cMessage *msg) {
 }
 
 void TDMAMac::handleSelfMessage(cMessage *msg) {
-    if (strcmp(msg->getName(), "TxComplete") == 0) {
-        delete msg;
+    if (msg == txCompleteMsg) {
         txState = TX_IDLE;
+        if (shapedSending >= 0) {
+            shapers[shapedSending].endTx(simTime(), !shapedQueues[shapedSending].isEmpty(), gates);
+            shapedSending = -1;
+        }
+        startTransmission();
+        
+    } else if (msg == modeTimer) {
+        // Nuove finestre: il best-effort in attesa va rivalutato
+        modeSchedule.advance(modeSchedule.nextCycle(), currentMode);
+        if (currentMode >= (int)modeGates.size()) {
+            throw cRuntimeError("Modo %d senza finestre in modeReservedWindows", currentMode);
+        }
+        gates = modeGates[currentMode];
+        if (modeSchedule.lastRequest() >= 0) emit(modeLatencySignal, simTime() - modeSchedule.lastRequest());
+        if (txState == TX_IDLE) {
+            startTransmission();
+        }
+        scheduleModeSwitch();
         
-        if (!txQueue.isEmpty()) {
+    } else if (msg == beGateMsg) {
+        if (txState == TX_IDLE) {
             startTransmission();
         }
         
@@ -54,10 +124,35 @@ void TDMAMac::handleSelfMessage(cMessage *msg) {
         if (!rxQueue.isEmpty()) {
             processNextRx();
         }
+        
+    } else if (msg == statsTimer) {
+        txStats.sampleUtilization(statsInterval);
+        scheduleAt(simTime() + statsInterval, statsTimer);
     }
 }
 
 void TDMAMac::handleUpperMessage(cPacket *pkt) {
+    pkt->setTimestamp(simTime());  // Ingresso in coda, per residence time
+    
+    TDMAFrame *frame = dynamic_cast<TDMAFrame*>(pkt);
+    if (frame && frame->getTrafficType() == TRAFFIC_SHAPED) {
+        int c = std::min((int)frame->getPriority(), tdma::NUM_TRAFFIC_CLASSES - 1);
+        shapers[c].advance(simTime(), !shapedQueues[c].isEmpty(), gates);
+        shapedQueues[c].insert(pkt);
+        shapers[c].maxQueue = std::max(shapers[c].maxQueue, (long)shapedQueues[c].getLength());
+        if (txState == TX_IDLE) {
+            startTransmission();
+        }
+        return;
+    }
+    if (frame && frame->getTrafficType() == TRAFFIC_BEST_EFFORT) {
+        beQueue.insert(pkt);
+        if (txState == TX_IDLE && !beGateMsg->isScheduled()) {
+            startTransmission();
+        }
+        return;
+    }
+    
     txQueue.insert(pkt);
     
     int qSize = txQueue.getLength();
@@ -65,7 +160,7 @@ void TDMAMac::handleUpperMessage(cPacket *pkt) {
         maxTxQueueSize = qSize;
     }
     
-    emit(registerSignal("txQueueLength"), qSize);
+    emit(txQueueLengthSignal, qSize);
     
     if (txState == TX_IDLE) {
         startTransmission();
@@ -73,6 +168,12 @@ void TDMAMac::handleUpperMessage(cPacket *pkt) {
 }
 
 void TDMAMac::handleLowerMessage(cPacket *pkt) {
+    // Frame gia' ricevuto per intero: nessun ritardo aggiuntivo
+    if (rxMode == RX_DIRECT) {
+        send(pkt, "upperOut");
+        return;
+    }
+    
     if (rxState != RX_IDLE) {
         rxQueue.insert(pkt);
         
@@ -81,31 +182,129 @@ void TDMAMac::handleLowerMessage(cPacket *pkt) {
             maxRxQueueSize = qSize;
         }
         
-        emit(registerSignal("rxQueueLength"), qSize);
+        emit(rxQueueLengthSignal, qSize);
     } else {
         currentRxFrame = pkt;
         rxState = RX_BUSY;
         
-        simtime_t procTime = SimTime(pkt->getBitLength() / datarate, SIMTIME_S);
-        scheduleAt(simTime() + procTime, new cMessage("RxComplete"));
+        scheduleAt(simTime() + rxProcessingTime(pkt), new cMessage("RxComplete"));
     }
 }
 
+// Il traffico schedulato ha sempre precedenza; shaped e best-effort escono solo se
+// terminano prima della prossima finestra riservata
 void TDMAMac::startTransmission() {
-    if (txQueue.isEmpty()) {
+    cancelEvent(beGateMsg);
+    
+    simtime_t wakeAt = SIMTIME_MAX;
+    cPacket *pkt = nextScheduled(wakeAt);
+    if (!pkt) pkt = nextShaped(wakeAt);
+    if (!pkt) pkt = nextBestEffort(wakeAt);
+    if (!pkt) {
         txState = TX_IDLE;
+        if (wakeAt != SIMTIME_MAX) scheduleAt(wakeAt, beGateMsg);
         return;
     }
-    
-    cPacket *pkt = check_and_cast<cPacket*>(txQueue.pop());
     txState = TX_BUSY;
     
     simtime_t txTime = SimTime(pkt->getBitLength() / datarate, SIMTIME_S);
     
+    TDMAFrame *frame = dynamic_cast<TDMAFrame*>(pkt);
+    txStats.recordTx(frame ? frame->getPriority() : tdma::NUM_TRAFFIC_CLASSES - 1,
+                     pkt->getByteLength(), txTime, pkt->getTimestamp());
+    
     send(pkt, "lowerOut");
-    scheduleAt(simTime() + txTime, new cMessage("TxComplete"));
+    scheduleAt(simTime() + txTime, txCompleteMsg);
     
-    emit(registerSignal("txQueueLength"), txQueue.getLength());
+    emit(txQueueLengthSignal, txQueue.getLength());
+}
+
+// Frame schedulato in testa, se il suo slot e' iniziato. I frame consegnati in burst
+// attendono txNotBefore: shaped e best-effort possono usare l'attesa solo se terminano
+// prima della finestra riservata (gates)
+cPacket *TDMAMac::nextScheduled(simtime_t& wakeAt) {
+    if (txQueue.isEmpty()) return nullptr;
+    TDMAFrame *frame = dynamic_cast<TDMAFrame*>(txQueue.front());
+    if (frame && frame->getTxNotBefore() > simTime()) {
+        wakeAt = frame->getTxNotBefore();
+        return nullptr;
+    }
+    return txQueue.pop();
+}
+
+// Frame della classe CBS piu' prioritaria con credito non negativo che termina prima
+// della prossima finestra riservata; altrimenti nullptr e wakeAt al primo sblocco
+cPacket *TDMAMac::nextShaped(simtime_t& wakeAt) {
+    simtime_t now = simTime();
+    for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+        cPacketQueue& queue = shapedQueues[c];
+        tdma::CreditShaper& shaper = shapers[c];
+        if (queue.isEmpty()) continue;
+        shaper.advance(now, true, gates);
+        
+        while (!queue.isEmpty()) {
+            cPacket *pkt = queue.front();
+            simtime_t txTime = SimTime(pkt->getBitLength() / datarate, SIMTIME_S);
+            simtime_t fit = gates.nextFit(now, txTime);
+            
+            if (fit < 0) {
+                EV_WARN << "Frame shaped " << pkt->getName() << " piu' lungo di ogni intervallo libero, scartato" << endl;
+                delete queue.pop();
+                shaper.drop();
+                continue;
+            }
+            if (!shaper.eligible()) {
+                shaper.creditWait();
+                wakeAt = std::min(wakeAt, std::max(fit, shaper.readyAt(now)));
+            } else if (fit > now) {
+                wakeAt = std::min(wakeAt, fit);
+            } else {
+                queue.pop();
+                shaper.startTx(now, pkt->getTimestamp(), gates);
+                shapedSending = c;
+                return pkt;
+            }
+            break;
+        }
+    }
+    return nullptr;
+}
+
+// Frame best-effort trasmissibile adesso, oppure nullptr con wakeAt sulla fine della
+// finestra che lo blocca
+cPacket *TDMAMac::nextBestEffort(simtime_t& wakeAt) {
+    while (!beQueue.isEmpty()) {
+        cPacket *pkt = beQueue.front();
+        simtime_t txTime = SimTime(pkt->getBitLength() / datarate, SIMTIME_S);
+        simtime_t fit = gates.nextFit(simTime(), txTime);
+        
+        if (fit < 0) {
+            EV_WARN << "Frame best-effort " << pkt->getName() << " piu' lungo di ogni intervallo libero, scartato" << endl;
+            delete beQueue.pop();
+            beDropped++;
+        } else if (fit > simTime()) {
+            beDeferred++;
+            wakeAt = std::min(wakeAt, fit);
+            return nullptr;
+        } else {
+            return beQueue.pop();
+        }
+    }
+    return nullptr;
+}
+
+// Cambio di modo richiesto a runtime: nuovo confine da attendere se non ce n'era uno
+void TDMAMac::handleParameterChange(const char *name) {
+    if (strcmp(name, "modeSwitches") != 0) return;
+    modeSchedule.update(par("modeSwitches").stringValue());
+    if (!modeTimer->isScheduled()) scheduleModeSwitch();
+}
+
+void TDMAMac::scheduleModeSwitch() {
+    long cycle = modeSchedule.nextCycle();
+    if (cycle >= 0) {
+        scheduleAt(hyperperiod * cycle, modeTimer);
+    }
 }
 
 void TDMAMac::processNextRx() {
@@ -113,17 +312,58 @@ void TDMAMac::processNextRx() {
         currentRxFrame = check_and_cast<cPacket*>(rxQueue.pop());
         rxState = RX_BUSY;
         
-        simtime_t procTime = SimTime(currentRxFrame->getBitLength() / datarate, SIMTIME_S);
-        scheduleAt(simTime() + procTime, new cMessage("RxComplete"));
+        scheduleAt(simTime() + rxProcessingTime(currentRxFrame), new cMessage("RxComplete"));
         
-        emit(registerSignal("rxQueueLength"), rxQueue.getLength());
+        emit(rxQueueLengthSignal, rxQueue.getLength());
     }
 }
 
+// Tempo tra consegna dal canale e passaggio all'applicazione
+simtime_t TDMAMac::rxProcessingTime(cPacket *pkt) const {
+    if (rxMode == RX_RECEPTION_START) {
+        return pkt->getDuration();  // Resto della ricezione sul filo
+    }
+    return SimTime(pkt->getBitLength() / datarate, SIMTIME_S);
+}
+
+void TDMAMac::visitCycle(tdma::CycleTracker& t) {
+    txStats.visitCycle(t);
+    t.counter(beDeferred);
+    t.counter(beDropped);
+    t.state(txQueue.getLength());
+    t.state(rxQueue.getLength());
+    t.state(beQueue.getLength());
+    for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+        shapers[c].visitCycle(t);
+        t.state(shapedQueues[c].getLength());
+    }
+    t.state(shapedSending);
+    t.state(currentMode);
+    t.state(txState);
+    t.state(rxState);
+    t.state(maxTxQueueSize);
+    t.state(maxRxQueueSize);
+}
+
 void TDMAMac::finish() {
     recordScalar("maxTxQueueSize", maxTxQueueSize);
     recordScalar("maxRxQueueSize", maxRxQueueSize);
+    recordScalar("beDeferred", beDeferred);
+    recordScalar("beDropped", beDropped);
+    txStats.record(this, "tx_", simTime() + fastForwarded);
+    for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+        shapers[c].record(this, "cbs" + std::to_string(c) + "_");
+    }
+    
+    cancelAndDelete(statsTimer);
+    cancelAndDelete(txCompleteMsg);
+    cancelAndDelete(beGateMsg);
+    cancelAndDelete(modeTimer);
+    delete txStats.utilizationVector;
+    txStats.utilizationVector = nullptr;
     
     EV << "MAC " << macAddress << " - MaxTxQ: " << maxTxQueueSize 
        << ", MaxRxQ: " << maxRxQueueSize << endl;
+    
+    if (profiling) tdma::EventProfiler::instance().detach();
 }
@@ -3,38 +3,88 @@
 
 #include <omnetpp.h>
 #include <string>
+#include "../../../core/common/PortStats.h"
+#include "../../../core/common/SteadyState.h"
+#include "../../../core/common/EventProfiler.h"
+#include "../../../core/common/GateSchedule.h"
+#include "../../../core/common/ModeSchedule.h"
+#include "../../../core/common/CreditShaper.h"
+#include <vector>
 
 using namespace omnetpp;
 
-class TDMAMac : public cSimpleModule {
+class TDMAMac : public cSimpleModule, public tdma::SteadyStateParticipant {
 protected:
     enum TxState { TX_IDLE, TX_BUSY };
     enum RxState { RX_IDLE, RX_BUSY };
     
+    // Modello ricezione:
+    // DIRECT            consegna a fine ricezione (la serializzazione e' gia' nel DatarateChannel)
+    // RECEPTION_START   consegna anticipata dal canale, il MAC attende la durata sul filo
+    // SERIALIZED        legacy: ulteriore bitLength/datarate dopo la fine ricezione
+    enum RxMode { RX_DIRECT, RX_RECEPTION_START, RX_SERIALIZED };
+    
     cPacketQueue txQueue;
     cPacketQueue rxQueue;
+    cPacketQueue beQueue;        // Best-effort: trasmesso solo fuori dalle finestre riservate
+    
+    // Classi con credit-based shaper: dopo lo schedulato e prima del best-effort,
+    // anch'esse solo fuori dalle finestre riservate
+    cPacketQueue shapedQueues[tdma::NUM_TRAFFIC_CLASSES];
+    tdma::CreditShaper shapers[tdma::NUM_TRAFFIC_CLASSES];
+    int shapedSending;           // Classe CBS in trasmissione (-1 = nessuna)
     
     double datarate;
     std::string macAddress;
     
     TxState txState;
     RxState rxState;
+    RxMode rxMode;
     
     cPacket *currentRxFrame;
+    cMessage *txCompleteMsg;     // Timer fine trasmissione riutilizzato
+    cMessage *beGateMsg;         // Sblocco di shaped/best-effort in attesa (finestra o credito)
+    tdma::GateSchedule gates;    // Finestre riservate del link di uscita
+    long beDeferred;             // Attese per una finestra riservata
+    long beDropped;              // Frame piu' lunghi di ogni intervallo libero
+    
+    // Finestre per modo operativo, sostituite al confine di hyperperiod
+    std::vector<tdma::GateSchedule> modeGates;
+    tdma::ModeSchedule modeSchedule;
+    int currentMode;
+    simtime_t hyperperiod;
+    cMessage *modeTimer;
     
     int maxTxQueueSize;
     int maxRxQueueSize;
     
+    // Statistiche porta di uscita
+    tdma::PortStats txStats;
+    simtime_t statsInterval;
+    bool profiling;             // profileEvents
+    tdma::EventProfiler::ModuleCache profileCache;
+    cMessage *statsTimer;
+    simsignal_t txQueueLengthSignal;
+    simsignal_t rxQueueLengthSignal;
+    simsignal_t modeLatencySignal;
+    
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
+    virtual void handleParameterChange(const char *name) override;
+    virtual void visitCycle(tdma::CycleTracker& t) override;
     
 private:
     void handleSelfMessage(cMessage *msg);
     void handleUpperMessage(cPacket *pkt);
     void handleLowerMessage(cPacket *pkt);
     void startTransmission();
+    cPacket *nextScheduled(simtime_t& wakeAt);
+    cPacket *nextShaped(simtime_t& wakeAt);
+    cPacket *nextBestEffort(simtime_t& wakeAt);
+    void scheduleModeSwitch();
     void processNextRx();
+    simtime_t rxProcessingTime(cPacket *pkt) const;
 };
 
 #endif
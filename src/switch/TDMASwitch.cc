@@ -1,12 +1,16 @@
 // Implementazione switch
 #include "TDMASwitch.h"
 #include "../core/common/Constants.h"
+#include "../core/common/MacAddress.h"
 #include "../messages/TDMAFrame_m.h"
+#include <algorithm>
 #include <sstream>
 
 Define_Module(TDMASwitch);
 
 void TDMASwitch::initialize() {
+    profiling = par("profileEvents");
+    if (profiling) tdma::EventProfiler::instance().attach();
     numPorts = par("numPorts");
     switchingDelay = par("switchingDelay");
     
@@ -15,7 +19,51 @@ void TDMASwitch::initialize() {
         maxQueueDepth[i] = 0;
     }
     
+    portStats.assign(numPorts, tdma::PortStats());
+    
+    // Velocita' per porta letta dal canale collegato
+    portDatarate.assign(numPorts, tdma::DATARATE);
+    for (int i = 0; i < numPorts; i++) {
+        portDatarate[i] = tdma::getLinkDatarate(gate("port$o", i));
+    }
+    queueLengthSignal = registerSignal("queueLength");
+    
+    shapedQueues.assign(numPorts, std::vector<std::queue<cPacket*>>(tdma::NUM_TRAFFIC_CLASSES));
+    portShapers.assign(numPorts, std::vector<tdma::CreditShaper>(tdma::NUM_TRAFFIC_CLASSES));
+    shapedSending.assign(numPorts, -1);
+    loadIdleSlopes();
+    
+    // Utilizzo a intervalli: un solo campione per porta per intervallo
+    statsInterval = par("statsInterval");
+    statsTimer = nullptr;
+    if (statsInterval > 0) {
+        for (int i = 0; i < numPorts; i++) {
+            std::string name = "port" + std::to_string(i) + "_utilization";
+            portStats[i].utilizationVector = new cOutVector(name.c_str());
+        }
+        statsTimer = new cMessage("StatsTick");
+        scheduleAt(simTime() + statsInterval, statsTimer);
+    }
+    
     loadMacTable();
+    hyperperiod = par("hyperperiod");
+    portGates = parseReservedWindows(par("reservedWindows").stringValue());
+    for (const auto& spec : tdma::ModeSchedule::splitModes(par("modeReservedWindows").stringValue())) {
+        modeGates.push_back(parseReservedWindows(spec));
+    }
+    modeSchedule.parse(par("modeSwitches").stringValue());
+    modeLatencySignal = registerSignal("modeTransitionLatency");
+    currentMode = 0;
+    modeTimer = new cMessage("ModeSwitch");
+    scheduleModeSwitch();
+    
+    beDeferred.assign(numPorts, 0);
+    beDropped.assign(numPorts, 0);
+    beGateTimers.assign(numPorts, nullptr);
+    for (int i = 0; i < numPorts; i++) {
+        beGateTimers[i] = new cMessage("BeGate");
+        beGateTimers[i]->setKind(i);
+    }
     
     EV << "=== TDMASwitch " << getName() << " ===" << endl;
     EV << "Ports: " << numPorts << ", MAC entries: " << macTable.size() << endl;
@@ -57,7 +105,7 @@ void TDMASwitch::loadMacTable() {
         }
 
         if (!ports.empty()) {
-            macTable[mac] = ports;
+            macTable[tdma::parseMac(mac)] = ports;
             EV_DEBUG << "MAC " << mac << " -> ports [";
             for(int p : ports) EV_DEBUG << p << " ";
             EV_DEBUG << "]" << endl;
@@ -65,7 +113,62 @@ void TDMASwitch::loadMacTable() {
     }
 }
 
+// Idle slope del credit-based shaper per porta e classe
+// Formato: "port->classe:bps;classe:bps,port->..."
+void TDMASwitch::loadIdleSlopes() {
+    std::stringstream ss(par("cbsIdleSlopes").stringValue());
+    std::string entry;
+    while (std::getline(ss, entry, ',')) {
+        size_t arrowPos = entry.find("->");
+        if (arrowPos == std::string::npos) continue;
+        
+        int port = std::stoi(entry.substr(0, arrowPos));
+        if (port < 0 || port >= numPorts) {
+            throw cRuntimeError("cbsIdleSlopes: porta %d inesistente", port);
+        }
+        std::vector<double> slopes = tdma::CreditShaper::parseSlopes(entry.substr(arrowPos + 2));
+        for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+            portShapers[port][c].configure(slopes[c], portDatarate[port]);
+        }
+    }
+}
+
+// Finestre riservate per porta di uscita
+// Formato: "port->inizio:fine;inizio:fine,port->..."
+std::vector<tdma::GateSchedule> TDMASwitch::parseReservedWindows(const std::string& config) const {
+    std::vector<tdma::GateSchedule> gates(numPorts);
+    
+    std::stringstream ss(config);
+    std::string entry;
+    while (std::getline(ss, entry, ',')) {
+        size_t arrowPos = entry.find("->");
+        if (arrowPos == std::string::npos) continue;
+        
+        int port = std::stoi(entry.substr(0, arrowPos));
+        if (port < 0 || port >= numPorts) {
+            throw cRuntimeError("reservedWindows: porta %d inesistente", port);
+        }
+        gates[port].parse(entry.substr(arrowPos + 2), hyperperiod);
+    }
+    return gates;
+}
+
+// Cambio di modo richiesto a runtime: nuovo confine da attendere se non ce n'era uno
+void TDMASwitch::handleParameterChange(const char *name) {
+    if (strcmp(name, "modeSwitches") != 0) return;
+    modeSchedule.update(par("modeSwitches").stringValue());
+    if (!modeTimer->isScheduled()) scheduleModeSwitch();
+}
+
+void TDMASwitch::scheduleModeSwitch() {
+    long cycle = modeSchedule.nextCycle();
+    if (cycle >= 0) {
+        scheduleAt(hyperperiod * cycle, modeTimer);
+    }
+}
+
 void TDMASwitch::handleMessage(cMessage *msg) {
+    tdma::EventProfiler::Scope profile(profiling ? tdma::EventProfiler::instance().entry(profileCache, this, msg) : nullptr);
     if (msg->isSelfMessage()) {
         handleSelfMessage(msg);
     } else {
@@ -83,56 +186,104 @@ void TDMASwitch::handleIncomingFrame(cPacket *pkt) {
         return;
     }
     
-    EV_DEBUG << "Rx port " << arrivalPort << ": " << frame->getSrcAddr() 
-             << " -> " << frame->getDstAddr() << endl;
+    EV_DEBUG << "Rx port " << arrivalPort << ": " << tdma::formatMac(frame->getSrcAddr())
+             << " -> " << tdma::formatMac(frame->getDstAddr()) << endl;
     
-    // Simula switching delay
-    cMessage *processMsg = new cMessage("ProcessFrame");
-    processMsg->setContextPointer(frame);
-    processMsg->setKind(arrivalPort);
-    scheduleAt(simTime() + switchingDelay, processMsg);
+    // Simula switching delay: il frame stesso fa da self-message, con la porta
+    // di ingresso nel kind (nessun puntatore di contesto, sicuro in parsim)
+    frame->setKind(arrivalPort);
+    scheduleAt(simTime() + switchingDelay, frame);
 }
 
 void TDMASwitch::handleSelfMessage(cMessage *msg) {
-    if (strcmp(msg->getName(), "ProcessFrame") == 0) {
-        TDMAFrame *frame = static_cast<TDMAFrame*>(msg->getContextPointer());
-        int arrivalPort = msg->getKind();
-        delete msg;
+    if (TDMAFrame *frame = dynamic_cast<TDMAFrame*>(msg)) {
+        int arrivalPort = frame->getKind();
+        frame->setKind(0);
         processAndForward(frame, arrivalPort);
         
     } else if (strcmp(msg->getName(), "TxComplete") == 0) {
         int port = msg->getKind();
         delete msg;
         portBusy[port] = false;
+        int c = shapedSending[port];
+        if (c >= 0) {
+            portShapers[port][c].endTx(simTime(), !shapedQueues[port][c].empty(), portGates[port]);
+            shapedSending[port] = -1;
+        }
         transmitFrame(port);
+        
+    } else if (msg == modeTimer) {
+        // Nuove finestre: il best-effort in attesa su ogni porta va rivalutato
+        modeSchedule.advance(modeSchedule.nextCycle(), currentMode);
+        if (currentMode >= (int)modeGates.size()) {
+            throw cRuntimeError("Modo %d senza finestre in modeReservedWindows", currentMode);
+        }
+        portGates = modeGates[currentMode];
+        if (modeSchedule.lastRequest() >= 0) emit(modeLatencySignal, simTime() - modeSchedule.lastRequest());
+        for (int i = 0; i < numPorts; i++) {
+            transmitFrame(i);
+        }
+        scheduleModeSwitch();
+        
+    } else if (strcmp(msg->getName(), "BeGate") == 0) {
+        transmitFrame(msg->getKind());
+        
+    } else if (msg == statsTimer) {
+        sampleStats();
+        scheduleAt(simTime() + statsInterval, statsTimer);
     }
 }
 
-void TDMASwitch::processAndForward(TDMAFrame *frame, int arrivalPort) {
-    std::string dstMac = frame->getDstAddr();
-    std::string srcMac = frame->getSrcAddr();
+void TDMASwitch::sampleStats() {
+    for (auto& stats : portStats) {
+        stats.sampleUtilization(statsInterval);
+    }
+}
 
-    EV << getName() << ": " << srcMac << " -> " << dstMac 
-       << " (port " << arrivalPort << ")" << endl;
-    
+void TDMASwitch::processAndForward(TDMAFrame *frame, int arrivalPort) {
+    EV << getName() << ": " << tdma::formatMac(frame->getSrcAddr()) << " -> "
+       << tdma::formatMac(frame->getDstAddr()) << " (port " << arrivalPort << ")" << endl;
 
-    // Lookup destinazione
-    std::vector<int> destPorts;
-    auto it = macTable.find(dstMac);
+    // Lookup destinazione su chiave intera
+    std::vector<int> flood;
+    const std::vector<int> *destPorts = &flood;
+    auto it = macTable.find(frame->getDstAddr());
     if (it != macTable.end()) {
-        destPorts = it->second;
+        destPorts = &it->second;
     } else {
-        // Flooding se MAC sconosciuto
+        // Flooding se MAC sconosciuto (porte non collegate escluse: reti generate)
         for (int i = 0; i < numPorts; i++) {
-            if (i != arrivalPort) destPorts.push_back(i);
+            if (i != arrivalPort && gate("port$o", i)->isConnected()) flood.push_back(i);
         }
     }
 
     // Inoltra su tutte le porte destinazione
-    for (int destPort : destPorts) {
+    for (int destPort : *destPorts) {
         if (destPort == arrivalPort) continue;
         
         TDMAFrame *copy = frame->dup();
+        copy->setTimestamp(simTime());  // Ingresso in coda, per residence time
+        
+        if (copy->getTrafficType() == TRAFFIC_SHAPED) {
+            int c = std::min((int)copy->getPriority(), tdma::NUM_TRAFFIC_CLASSES - 1);
+            std::queue<cPacket*>& queue = shapedQueues[destPort][c];
+            tdma::CreditShaper& shaper = portShapers[destPort][c];
+            shaper.advance(simTime(), !queue.empty(), portGates[destPort]);
+            queue.push(copy);
+            shaper.maxQueue = std::max(shaper.maxQueue, (long)queue.size());
+            if (!portBusy[destPort]) {
+                transmitFrame(destPort);
+            }
+            continue;
+        }
+        
+        if (copy->getTrafficType() == TRAFFIC_BEST_EFFORT) {
+            beQueues[destPort].push(copy);
+            if (!portBusy[destPort] && !beGateTimers[destPort]->isScheduled()) {
+                transmitFrame(destPort);
+            }
+            continue;
+        }
         
         portQueues[destPort].push(copy);
         
@@ -140,7 +291,7 @@ void TDMASwitch::processAndForward(TDMAFrame *frame, int arrivalPort) {
         if (qSize > maxQueueDepth[destPort]) {
             maxQueueDepth[destPort] = qSize;
         }
-        emit(registerSignal("queueLength"), qSize);
+        emit(queueLengthSignal, qSize);
         
         if (!portBusy[destPort]) {
             transmitFrame(destPort);
@@ -150,21 +301,34 @@ void TDMASwitch::processAndForward(TDMAFrame *frame, int arrivalPort) {
     delete frame;
 }
 
-// Trasmette frame dalla coda FIFO
+// Trasmette frame dalla coda FIFO; shaped e best-effort solo a coda schedulata vuota
 void TDMASwitch::transmitFrame(int port) {
     if (portBusy[port]) return;
+    cancelEvent(beGateTimers[port]);
     
+    cPacket *frame = nullptr;
     if (!portQueues[port].empty()) {
-        cPacket *frame = portQueues[port].front();
+        frame = portQueues[port].front();
         portQueues[port].pop();
-        
+    } else {
+        simtime_t wakeAt = SIMTIME_MAX;
+        frame = nextShaped(port, wakeAt);
+        if (!frame) frame = nextBestEffort(port, wakeAt);
+        if (!frame && wakeAt != SIMTIME_MAX) scheduleAt(wakeAt, beGateTimers[port]);
+    }
+    
+    if (frame) {
         portBusy[port] = true;
         
         uint64_t bits = frame->getBitLength();
-        simtime_t txTime = SimTime((double)bits / tdma::DATARATE, SIMTIME_S);
+        simtime_t txTime = SimTime((double)bits / portDatarate[port], SIMTIME_S);
         
         EV_DEBUG << "Tx port " << port << " (" << bits << " bits)" << endl;
         
+        TDMAFrame *tdmaFrame = static_cast<TDMAFrame*>(frame);
+        portStats[port].recordTx(tdmaFrame->getPriority(), frame->getByteLength(),
+                                 txTime, frame->getTimestamp());
+        
         send(frame, "port$o", port);
         
         cMessage *txComplete = new cMessage("TxComplete");
@@ -173,6 +337,89 @@ void TDMASwitch::transmitFrame(int port) {
     }
 }
 
+// Frame della classe CBS piu' prioritaria con credito non negativo che termina prima
+// della prossima finestra riservata; altrimenti nullptr e wakeAt al primo sblocco
+cPacket *TDMASwitch::nextShaped(int port, simtime_t& wakeAt) {
+    simtime_t now = simTime();
+    for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+        std::queue<cPacket*>& queue = shapedQueues[port][c];
+        tdma::CreditShaper& shaper = portShapers[port][c];
+        if (queue.empty()) continue;
+        shaper.advance(now, true, portGates[port]);
+        
+        while (!queue.empty()) {
+            cPacket *frame = queue.front();
+            simtime_t txTime = SimTime((double)frame->getBitLength() / portDatarate[port], SIMTIME_S);
+            simtime_t fit = portGates[port].nextFit(now, txTime);
+            
+            if (fit < 0) {
+                EV_WARN << "Port " << port << ": frame shaped piu' lungo di ogni intervallo libero, scartato" << endl;
+                queue.pop();
+                delete frame;
+                shaper.drop();
+                continue;
+            }
+            if (!shaper.eligible()) {
+                shaper.creditWait();
+                wakeAt = std::min(wakeAt, std::max(fit, shaper.readyAt(now)));
+            } else if (fit > now) {
+                wakeAt = std::min(wakeAt, fit);
+            } else {
+                queue.pop();
+                shaper.startTx(now, frame->getTimestamp(), portGates[port]);
+                shapedSending[port] = c;
+                return frame;
+            }
+            break;
+        }
+    }
+    return nullptr;
+}
+
+// Frame best-effort trasmissibile adesso sulla porta, oppure nullptr con wakeAt sulla
+// fine della finestra riservata che lo blocca
+cPacket *TDMASwitch::nextBestEffort(int port, simtime_t& wakeAt) {
+    std::queue<cPacket*>& queue = beQueues[port];
+    while (!queue.empty()) {
+        cPacket *frame = queue.front();
+        simtime_t txTime = SimTime((double)frame->getBitLength() / portDatarate[port], SIMTIME_S);
+        simtime_t fit = portGates[port].nextFit(simTime(), txTime);
+        
+        if (fit < 0) {
+            EV_WARN << "Port " << port << ": frame best-effort piu' lungo di ogni intervallo libero, scartato" << endl;
+            queue.pop();
+            delete frame;
+            beDropped[port]++;
+        } else if (fit > simTime()) {
+            beDeferred[port]++;
+            wakeAt = std::min(wakeAt, fit);
+            return nullptr;
+        } else {
+            queue.pop();
+            return frame;
+        }
+    }
+    return nullptr;
+}
+
+void TDMASwitch::visitCycle(tdma::CycleTracker& t) {
+    for (int i = 0; i < numPorts; i++) {
+        portStats[i].visitCycle(t);
+        t.counter(beDeferred[i]);
+        t.counter(beDropped[i]);
+        t.state(portQueues[i].size());
+        t.state(beQueues[i].size());
+        for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+            portShapers[i][c].visitCycle(t);
+            t.state(shapedQueues[i][c].size());
+        }
+        t.state(shapedSending[i]);
+        t.state(portBusy[i]);
+        t.state(maxQueueDepth[i]);
+    }
+    t.state(currentMode);
+}
+
 void TDMASwitch::finish() {
     EV << "=== Switch " << getName() << " Stats ===" << endl;
     
@@ -182,5 +429,37 @@ void TDMASwitch::finish() {
             recordScalar(("port" + std::to_string(i) + "_maxQueue").c_str(), 
                          maxQueueDepth[i]);
         }
+        portStats[i].record(this, "port" + std::to_string(i) + "_", simTime() + fastForwarded);
+        if (beDeferred[i] > 0 || beDropped[i] > 0) {
+            recordScalar(("port" + std::to_string(i) + "_beDeferred").c_str(), beDeferred[i]);
+            recordScalar(("port" + std::to_string(i) + "_beDropped").c_str(), beDropped[i]);
+        }
+        for (int c = 0; c < tdma::NUM_TRAFFIC_CLASSES; c++) {
+            portShapers[i][c].record(this, "port" + std::to_string(i) + "_cbs" + std::to_string(c) + "_");
+        }
+    }
+    
+    cancelAndDelete(statsTimer);
+    cancelAndDelete(modeTimer);
+    for (cMessage *timer : beGateTimers) cancelAndDelete(timer);
+    for (auto& entry : beQueues) {
+        while (!entry.second.empty()) {
+            delete entry.second.front();
+            entry.second.pop();
+        }
+    }
+    for (auto& classes : shapedQueues) {
+        for (auto& queue : classes) {
+            while (!queue.empty()) {
+                delete queue.front();
+                queue.pop();
+            }
+        }
     }
+    for (auto& stats : portStats) {
+        delete stats.utilizationVector;
+        stats.utilizationVector = nullptr;
+    }
+    
+    if (profiling) tdma::EventProfiler::instance().detach();
 }
@@ -4,36 +4,81 @@
 #include <omnetpp.h>
 #include <queue>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <vector>
+#include "../core/common/PortStats.h"
+#include "../core/common/SteadyState.h"
+#include "../core/common/EventProfiler.h"
+#include "../core/common/GateSchedule.h"
+#include "../core/common/ModeSchedule.h"
+#include "../core/common/CreditShaper.h"
 
 using namespace omnetpp;
 
 class TDMAFrame;
 
-class TDMASwitch : public cSimpleModule {
+class TDMASwitch : public cSimpleModule, public tdma::SteadyStateParticipant {
 protected:
     int numPorts;
     simtime_t switchingDelay;
     
-    // MAC -> lista porte uscita (multicast supportato)
-    std::map<std::string, std::vector<int>> macTable;
+    // MAC (48 bit) -> lista porte uscita, gruppi multicast compresi
+    std::unordered_map<uint64_t, std::vector<int>> macTable;
     
     // Coda FIFO per porta
     std::map<int, std::queue<cPacket*>> portQueues;
     
+    // Best-effort per porta: esce solo se termina prima della prossima finestra riservata
+    std::map<int, std::queue<cPacket*>> beQueues;
+    std::vector<tdma::GateSchedule> portGates;
+    std::vector<cMessage*> beGateTimers;   // Sblocco shaped/best-effort (finestra o credito), kind = porta
+    std::vector<long> beDeferred;
+    std::vector<long> beDropped;
+    
+    // Classi con credit-based shaper per porta: dopo lo schedulato, prima del best-effort
+    std::vector<std::vector<std::queue<cPacket*>>> shapedQueues;   // [porta][classe]
+    std::vector<std::vector<tdma::CreditShaper>> portShapers;
+    std::vector<int> shapedSending;        // Classe CBS in trasmissione (-1 = nessuna)
+    
+    // Finestre per modo operativo, sostituite al confine di hyperperiod
+    std::vector<std::vector<tdma::GateSchedule>> modeGates;
+    tdma::ModeSchedule modeSchedule;
+    int currentMode;
+    simtime_t hyperperiod;
+    cMessage *modeTimer;
+    
     std::map<int, bool> portBusy;
     std::map<int, int> maxQueueDepth;
+    std::vector<double> portDatarate;   // Dal DatarateChannel di ogni porta
+    
+    // Statistiche per porta (contatori fissi, scritte in finish)
+    std::vector<tdma::PortStats> portStats;
+    simtime_t statsInterval;
+    bool profiling;             // profileEvents
+    tdma::EventProfiler::ModuleCache profileCache;
+    cMessage *statsTimer;
+    simsignal_t queueLengthSignal;
+    simsignal_t modeLatencySignal;
     
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
     virtual void finish() override;
+    virtual void handleParameterChange(const char *name) override;
+    virtual void visitCycle(tdma::CycleTracker& t) override;
     
 private:
     void loadMacTable();
+    void loadIdleSlopes();
+    std::vector<tdma::GateSchedule> parseReservedWindows(const std::string& config) const;
+    void scheduleModeSwitch();
     void handleIncomingFrame(cPacket *pkt);
     void handleSelfMessage(cMessage *msg);
     void processAndForward(TDMAFrame *frame, int arrivalPort);
     void transmitFrame(int port);
+    cPacket *nextShaped(int port, simtime_t& wakeAt);
+    cPacket *nextBestEffort(int port, simtime_t& wakeAt);
+    void sampleStats();
 };
 
 #endif
\ No newline at end of file